@@ -16,6 +16,7 @@
 
 #include "vmem.h"
 
+#include <algorithm>
 #include <cassert>
 
 #include "champsim.h"
@@ -25,90 +26,797 @@
 
 #include <vector>
 #include <iostream>
+#include <fstream>
 #include <chrono>
+#include <stdexcept>
+#include <type_traits>
 
-uint64_t VirtualMemory::virtual_seed = 0;
+namespace
+{
+constexpr uint64_t CHECKPOINT_MAGIC = 0x54504b434d454d56; // "VMEMCKPT"
+constexpr uint64_t CHECKPOINT_VERSION = 10; // 2: per-cpu frame caches, 3: page coloring, 4: guard rows, 5: reservations, 6: shared pages, 7: NUMA nodes,
+                                           // 8: guarded page table frames, 9: ended reservations, 10: page table cursor per cpu
+
+struct checkpoint_header {
+  uint64_t magic = CHECKPOINT_MAGIC;
+  uint64_t version = CHECKPOINT_VERSION;
+  uint64_t page_size;
+  uint64_t pmem_size;
+  uint64_t pt_levels;
+  uint64_t pte_page_size;
+  uint64_t huge_pages;
+  uint64_t cpus;
+};
+
+struct checkpoint_root {
+  uint64_t key;
+  uint64_t node;
+};
+
+struct checkpoint_parked {
+  uint64_t row;
+  uint64_t frame;
+};
+
+template <typename T>
+void write_value(std::ostream& out, const T& value)
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void read_value(std::istream& in, T& value)
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+  if (!in.read(reinterpret_cast<char*>(&value), sizeof(T)))
+    throw std::runtime_error("VMEM checkpoint is truncated");
+}
+
+// a length, then the records, then zero padding up to the next 8-byte boundary
+template <typename T>
+void write_array(std::ostream& out, const std::vector<T>& values)
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+  write_value(out, uint64_t{values.size()});
+  out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+  constexpr char padding[8] = {};
+  out.write(padding, static_cast<std::streamsize>((8 - (values.size() * sizeof(T)) % 8) % 8));
+}
+
+template <typename T>
+void read_array(std::istream& in, std::vector<T>& values)
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+  uint64_t size;
+  read_value(in, size);
+  values.resize(size);
+  if (!in.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(size * sizeof(T))))
+    throw std::runtime_error("VMEM checkpoint is truncated");
+  in.ignore(static_cast<std::streamsize>((8 - (size * sizeof(T)) % 8) % 8));
+}
+} // namespace
 
 void VirtualMemory::set_virtual_seed(uint64_t v_seed)
 {
   virtual_seed = v_seed;
+  shuffle_pages();
 }
 
 // debug print staments within functions (mapping not working) check all the input variables going throught the created functions
 
+FramePermutation::FramePermutation(uint64_t domain_size, uint64_t seed) : domain(domain_size), half_bits((champsim::lg2(domain_size - 1) + 2) / 2)
+{
+  if (half_bits == 0)
+    half_bits = 1;
+
+  std::mt19937_64 rng(seed);
+  for (auto& key : round_keys)
+    key = rng();
+}
+
+uint64_t FramePermutation::encrypt(uint64_t value) const
+{
+  auto mask = champsim::bitmask(half_bits);
+  uint64_t left = value >> half_bits;
+  uint64_t right = value & mask;
+
+  for (auto key : round_keys) {
+    // splitmix64 finalizer as the round function
+    uint64_t mix = (right ^ key) * 0xbf58476d1ce4e5b9ull;
+    mix = (mix ^ (mix >> 31)) * 0x94d049bb133111ebull;
+    mix ^= mix >> 29;
+
+    uint64_t next_right = left ^ (mix & mask);
+    left = right;
+    right = next_right;
+  }
+
+  return (left << half_bits) | right;
+}
+
+uint64_t FramePermutation::operator()(uint64_t index) const
+{
+  // the network permutes [0, 4^half_bits), which is less than 4x the domain, so this loop runs a couple of times on average
+  do {
+    index = encrypt(index);
+  } while (index >= domain);
+  return index;
+}
+
+namespace
+{
+uint64_t bank_level(const dram_coordinates& coordinates, unsigned level)
+{
+  switch (level) {
+  case 0:
+    return coordinates.channel;
+  case 1:
+    return coordinates.rank;
+  case 2:
+    return coordinates.bankgroup;
+  default:
+    return coordinates.bank;
+  }
+}
+} // namespace
+
+// a bank bit colors frames only if no line offset inside the page can flip it; every mapper xors or slices whole bits,
+// so checking single-bit flips at two unrelated frames is enough
+FrameColoring::FrameColoring(dram_mapping frame_mapping, const dram_geometry& dram) : address_map(frame_mapping, dram), geometry(dram)
+{
+  const std::array<unsigned, 4> level_bits = {geometry.channel_bits, geometry.rank_bits, geometry.bankgroup_bits, geometry.bank_bits};
+  const std::array<uint64_t, 2> bases = {0, 0x2f5a3ull << LOG2_PAGE_SIZE};
+
+  for (unsigned level = 0; level < level_bits.size(); level++) {
+    for (unsigned bit = 0; bit < level_bits[level]; bit++) {
+      bool fixed = true;
+      for (auto base : bases) {
+        auto reference = (bank_level(address_map(base), level) >> bit) & 1;
+        for (unsigned offset = geometry.tx_offset; offset < LOG2_PAGE_SIZE; offset++)
+          fixed = fixed && ((bank_level(address_map(base | (1ull << offset)), level) >> bit) & 1) == reference;
+      }
+      if (fixed)
+        color_bits.emplace_back(level, bit);
+    }
+  }
+
+  unsigned address_bits = geometry.tx_offset + geometry.channel_bits + geometry.rank_bits + geometry.bankgroup_bits + geometry.bank_bits
+                          + geometry.row_bits + geometry.column_bits;
+  for (unsigned bit = 0; bit + LOG2_PAGE_SIZE < address_bits; bit++)
+    if ((*this)(1ull << bit) != (*this)(0))
+      span_order = bit + 1;
+}
+
+uint64_t FrameColoring::row_key(uint64_t frame) const
+{
+  return row_key(coordinates(frame));
+}
+
+std::size_t FrameColoring::operator()(uint64_t frame) const
+{
+  return color_of(coordinates(frame));
+}
+
+std::size_t FrameColoring::color_of(const dram_coordinates& coordinates) const
+{
+  std::size_t color = 0;
+  for (std::size_t i = 0; i < color_bits.size(); i++)
+    color |= ((bank_level(coordinates, color_bits[i].first) >> color_bits[i].second) & 1) << i;
+  return color;
+}
+
 // constructor for the buddy allocater class
+// the range is cut into the largest aligned blocks that fit, so this only costs one insert per order
 BuddyAllocator::BuddyAllocator(uint64_t start_frame, uint64_t end_frame)
+    : free_lists(champsim::lg2(end_frame) + 1), first_frame(start_frame), frame_count(end_frame - start_frame)
 {
-  
-  for (uint64_t i = start_frame; i < end_frame; i++) // filling up our list (equal in size to our real physical space)
-  {
-    free_frame_table.push_back(i);
-  }  
-  
+  while (start_frame < end_frame) {
+    std::size_t order = champsim::lg2(end_frame - start_frame);
+    while (start_frame & champsim::bitmask(order)) // shrink until the block is aligned to its size
+      order--;
+
+    insert_block(start_frame, order);
+    start_frame += 1ull << order;
+  }
+}
+
+void BuddyAllocator::insert_block(uint64_t frame, std::size_t order)
+{
+  free_lists[order].insert(frame);
+  free_frames += 1ull << order;
+}
+
+// hands back every half that does not contain the frame we want
+void BuddyAllocator::carve_frame(uint64_t block, std::size_t order, uint64_t frame)
+{
+  free_lists[order].erase(block);
+  free_frames -= 1ull << order;
+
+  while (order > 0) {
+    order--;
+    uint64_t half = 1ull << order;
+    if (frame >= block + half) {
+      insert_block(block, order);
+      block += half;
+    } else {
+      insert_block(block + half, order);
+    }
+  }
+}
+
+std::tuple<bool, uint64_t, std::size_t> BuddyAllocator::find_free_block(uint64_t frame) const
+{
+  for (std::size_t order = 0; order < free_lists.size(); order++) {
+    uint64_t block = frame & ~champsim::bitmask(order);
+    if (free_lists[order].count(block))
+      return {true, block, order};
+  }
+
+  return {false, 0, 0};
+}
+
+// the shared pool is empty: take back the cpu caches first, then the unused parts of reservations
+bool BuddyAllocator::refill_pool()
+{
+  if (cached_frames > 0)
+    drain_arenas();
+  else if (!reservations.empty())
+    break_reservation();
+  else
+    return false;
+  return true;
+}
+
+void BuddyAllocator::out_of_memory() const
+{
+  throw std::runtime_error(fmt::format("VMEM is out of physical memory: all {} frames are taken, {} of them by page tables", frame_count, metrics.pinned_frames));
+}
+
+uint64_t BuddyAllocator::allocate_block(std::size_t order)
+{
+  std::size_t from = order;
+  while (true) {
+    from = order;
+    while (from < free_lists.size() && free_lists[from].empty())
+      from++;
+    if (from < free_lists.size())
+      break;
+    if (!refill_pool())
+      out_of_memory();
+  }
+
+  uint64_t block = *free_lists[from].begin();
+  free_lists[from].erase(free_lists[from].begin());
+  free_frames -= 1ull << from;
+
+  while (from > order) { // keep the lower half, give back the upper one
+    from--;
+    insert_block(block + (1ull << from), from);
+  }
+
+  return block;
+}
+
+void BuddyAllocator::free_block(uint64_t frame, std::size_t order)
+{
+  free_frames += 1ull << order;
+
+  while (order + 1 < free_lists.size() && free_lists[order].erase(frame ^ (1ull << order))) { // merge while the buddy is free
+    frame &= ~(1ull << order);
+    order++;
+  }
+
+  free_lists[order].insert(frame);
 }
 
 // looking for an available frame with a preferred frame passed through (will normaly be the very first frame available)
-uint64_t BuddyAllocator::get_free_frame(uint64_t pref_frame, bool try_match){
+uint64_t BuddyAllocator::get_free_frame(uint64_t pref_frame, bool try_match, uint32_t cpu){
+
+  if (colored)
+    return get_colored_frame(pref_frame, try_match, cpu);
+
+  if (randomized) {
+    // the next frame in permutation order that is still free; contiguity is not a goal here, so the preferred frame is ignored
+    while (free_frames == 0)
+      if (!refill_pool())
+        out_of_memory();
+    for (uint64_t step = 0; step < frame_count; step++) { // one cycle of the permutation visits every frame
+      uint64_t frame = first_frame + permutation(permutation_cursor);
+      permutation_cursor = (permutation_cursor + 1) % frame_count;
+
+      auto [found, block, order] = find_free_block(frame);
+      if (found) {
+        carve_frame(block, order, frame);
+        return frame;
+      }
+    }
+    out_of_memory();
+  }
+
+  if (arena_batch_order > 0) {
+    // the preferred frame is usually the next one in this cpu's cache, otherwise it may still be in the shared pool
+    auto& owner = arena(cpu);
+    if (try_match) {
+      auto it = std::lower_bound(owner.cache.begin(), owner.cache.end(), pref_frame, std::greater<uint64_t>{});
+      if (it != owner.cache.end() && *it == pref_frame) {
+        owner.cache.erase(it);
+        cached_frames--;
+        return(pref_frame);
+      }
+
+      auto [found, block, order] = find_free_block(pref_frame);
+      if (found) {
+        carve_frame(block, order, pref_frame);
+        return(pref_frame);
+      }
+    }
+
+    if (owner.cache.empty())
+      refill_arena(owner);
+    uint64_t frame = owner.cache.back();
+    owner.cache.pop_back();
+    cached_frames--;
+    return(frame);
+  }
 
-  if(try_match)
-  for(int i = 0; i < free_frame_table.size(); i++){ // here we are searching for the preferred frame
-    if (pref_frame == free_frame_table[i]){
-      free_frame_table.erase(free_frame_table.begin() + i);
+  if (try_match) {
+    auto [found, block, order] = find_free_block(pref_frame); // here we are searching for the preferred frame
+    if (found) {
+      carve_frame(block, order, pref_frame);
       return(pref_frame); // in the case that the perferred frame is found we will return it
     }
   }
-  
-  pref_frame = free_frame_table[0];
-  free_frame_table.erase(free_frame_table.begin());
-  return (pref_frame); // In the case that it is not found we will return the first available frame 
+
+  return allocate_block(0); // In the case that it is not found we will return the lowest frame of the smallest free block
 }
 
-std::pair<bool,uint64_t> BuddyAllocator::can_merge(uint64_t page){
-  for (uint64_t i = 0; i < allocated_frame_table.size(); i++) // iterating through our allocated table vector
-  {
-    if (page == allocated_frame_table[i].start_page + allocated_frame_table[i].size){ // if we find a match then we incriment the size of the allocation by 1
-      return(std::pair<bool,uint64_t>{true,allocated_frame_table[i].start_frame + allocated_frame_table[i].size}); // returning the size variable of our allocation
-    }   
+std::size_t BuddyAllocator::largest_free_order() const
+{
+  for (std::size_t order = free_lists.size(); order > 0; order--)
+    if (!free_lists[order - 1].empty())
+      return order - 1;
+  return free_lists.size();
+}
+
+void BuddyAllocator::count_extent(const alloc_table_entry& entry, int64_t sign)
+{
+  auto bucket = std::min<std::size_t>(champsim::lg2(entry.size), metrics.extent_size_histogram.size() - 1);
+  metrics.extent_size_histogram[bucket] += static_cast<uint64_t>(sign);
+
+  if (entry.cpu >= metrics.frames_by_cpu.size())
+    metrics.frames_by_cpu.resize(entry.cpu + 1, 0);
+  metrics.frames_by_cpu[entry.cpu] += static_cast<uint64_t>(sign * static_cast<int64_t>(entry.size));
+}
+
+BuddyAllocator::allocation_metrics& BuddyAllocator::allocation_metrics::operator+=(const allocation_metrics& other)
+{
+  allocations += other.allocations;
+  merge_candidates += other.merge_candidates;
+  merges += other.merges;
+  huge_allocations += other.huge_allocations;
+  pinned_frames += other.pinned_frames;
+  for (std::size_t bucket = 0; bucket < extent_size_histogram.size(); bucket++)
+    extent_size_histogram[bucket] += other.extent_size_histogram[bucket];
+  if (other.frames_by_cpu.size() > frames_by_cpu.size())
+    frames_by_cpu.resize(other.frames_by_cpu.size(), 0);
+  for (std::size_t cpu = 0; cpu < other.frames_by_cpu.size(); cpu++)
+    frames_by_cpu[cpu] += other.frames_by_cpu[cpu];
+  color_fallbacks += other.color_fallbacks;
+  guard_rejections += other.guard_rejections;
+  guard_violations += other.guard_violations;
+  reservations += other.reservations;
+  reserved_faults += other.reserved_faults;
+  broken_reservations += other.broken_reservations;
+  return *this;
+}
+
+void BuddyAllocator::randomize(uint64_t seed)
+{
+  drain_arenas(); // randomized allocation only draws from the shared pool
+  randomized = true;
+  permutation_seed = seed;
+  permutation = FramePermutation{frame_count, seed};
+  permutation_cursor = 0;
+}
+
+BuddyAllocator::cpu_arena& BuddyAllocator::arena(uint32_t cpu)
+{
+  if (cpu >= arenas.size())
+    arenas.resize(cpu + 1);
+  return arenas[cpu];
+}
+
+void BuddyAllocator::enable_cpu_arenas(std::size_t batch_order)
+{
+  arena_batch_order = std::min(batch_order, max_order());
+}
+
+// takes the lowest block of the batch size, or the largest block left when memory is that fragmented
+void BuddyAllocator::refill_arena(cpu_arena& owner)
+{
+  if (free_frames == 0)
+    drain_arenas(); // the other cpus give back what they hold
+  std::size_t order = std::min(arena_batch_order, largest_free_order());
+  uint64_t block = allocate_block(order);
+
+  for (uint64_t frame = block + (1ull << order); frame > block; frame--)
+    owner.cache.push_back(frame - 1);
+  cached_frames += 1ull << order;
+}
+
+void BuddyAllocator::drain_arenas()
+{
+  for (auto& owner : arenas) {
+    for (auto frame : owner.cache)
+      free_block(frame, 0);
+    cached_frames -= owner.cache.size();
+    owner.cache.clear();
   }
+  for (auto& list : color_lists) {
+    for (auto frame : list)
+      free_block(frame, 0);
+    cached_frames -= list.size();
+    list.clear();
+  }
+}
 
-  return(std::pair<bool,uint64_t>{false,0});
+void BuddyAllocator::enable_coloring(const FrameColoring& frame_coloring, bool isolate, std::size_t domains)
+{
+  colored = true;
+  coloring = frame_coloring;
+  color_lists.assign(coloring.colors(), {});
+  coloring_isolate = isolate;
+  coloring_domains = std::clamp<std::size_t>(domains, 1, coloring.colors());
 }
 
-uint64_t BuddyAllocator::merging(uint64_t pref_frame, uint64_t cycle){
+// one aligned span holds every color, so a single refill is enough for whichever color ran out
+bool BuddyAllocator::refill_colors()
+{
+  if (free_frames == 0)
+    return false;
+
+  std::size_t order = std::min<std::size_t>(coloring.span(), largest_free_order());
+  uint64_t block = allocate_block(order);
+  for (uint64_t frame = block; frame < block + (1ull << order); frame++)
+    color_lists[coloring(frame)].insert(frame);
+  cached_frames += 1ull << order;
+  return true;
+}
 
+void BuddyAllocator::enable_guard_rows(const FrameColoring& frame_rows)
+{
+  guarded = true;
+  coloring = frame_rows;
+  row_owner.assign(coloring.colors() * coloring.rows(), 0);
+  row_frames.assign(row_owner.size(), 0);
+}
 
-  for (std::size_t i = 0; i < allocated_frame_table.size(); i++) //searching through the allocated table
-  {
-    std::cout << "index: " << i << ", size: " << allocated_frame_table.size() << std::endl;
-
-    // finding the mergable entry
-    if (pref_frame == allocated_frame_table[i].start_frame + allocated_frame_table[i].size) // getting segmention violation
-    {
-      
-      allocated_frame_table[i].size += 1; // incrimenting the size of the entry within the vector by one
-      
-      allocated_frame_table[i].last_access = cycle; //updating the current last accessed to the current cycle 
-    
-      return (0);
+bool BuddyAllocator::row_allowed(uint64_t key, uint16_t owner) const
+{
+  auto row = key % coloring.rows();
+  auto usable = [&](uint64_t k) { return row_owner[k] == 0 || row_owner[k] == owner; };
+  return usable(key) && (row == 0 || usable(key - 1)) && (row + 1 == coloring.rows() || usable(key + 1));
+}
+
+void BuddyAllocator::claim_row(uint64_t frame, uint32_t cpu)
+{
+  auto key = coloring.row_key(frame);
+  row_owner[key] = static_cast<uint16_t>(cpu + 1);
+  row_frames[key]++;
+}
+
+void BuddyAllocator::release_row(uint64_t frame)
+{
+  auto key = coloring.row_key(frame);
+  if (--row_frames[key] > 0)
+    return;
+
+  row_owner[key] = 0;
+  auto row = key % coloring.rows();
+  offer_parked(key);
+  if (row > 0)
+    offer_parked(key - 1);
+  if (row + 1 < coloring.rows())
+    offer_parked(key + 1);
+}
+
+void BuddyAllocator::offer_parked(uint64_t key)
+{
+  auto it = parked.find(key);
+  if (it == parked.end())
+    return;
+
+  auto row = key % coloring.rows();
+  std::array<uint16_t, 3> owners = {row_owner[key], row > 0 ? row_owner[key - 1] : uint16_t{0}, row + 1 < coloring.rows() ? row_owner[key + 1] : uint16_t{0}};
+  if (std::all_of(owners.begin(), owners.end(), [](auto owner) { return owner == 0; })) {
+    for (auto frame : it->second)
+      free_block(frame, 0);
+    parked_frames -= it->second.size();
+    parked.erase(it);
+    return;
+  }
+
+  for (auto owner : owners)
+    if (owner != 0 && row_allowed(key, owner))
+      arena(owner - 1).parked_rows.push_back(key);
+}
+
+uint64_t BuddyAllocator::get_guarded_frame(uint64_t pref_frame, bool try_match, uint32_t cpu)
+{
+  auto owner = static_cast<uint16_t>(cpu + 1);
+  auto take_parked = [&](decltype(parked)::iterator it) {
+    uint64_t frame = it->second.back();
+    it->second.pop_back();
+    parked_frames--;
+    if (it->second.empty())
+      parked.erase(it);
+    return frame;
+  };
+
+  // frames set aside earlier in rows this cpu may use come first
+  auto& rows = arena(cpu).parked_rows;
+  while (!rows.empty()) {
+    auto it = parked.find(rows.back());
+    if (it != parked.end() && row_allowed(it->first, owner)) {
+      uint64_t frame = take_parked(it);
+      claim_row(frame, cpu);
+      return frame;
     }
-    
+    rows.pop_back();
   }
 
+  while (free_frames + cached_frames > 0) {
+    uint64_t frame = get_free_frame(pref_frame, try_match, cpu);
+    try_match = false;
+
+    auto key = coloring.row_key(frame);
+    if (row_allowed(key, owner)) {
+      claim_row(frame, cpu);
+      return frame;
+    }
+
+    metrics.guard_rejections++;
+    auto& row = parked[key];
+    row.push_back(frame);
+    parked_frames++;
+    if (row.size() == 1)
+      offer_parked(key);
+  }
+
+  // only parked frames are left: one this cpu may use, or failing that any of them
+  auto it = std::find_if(parked.begin(), parked.end(), [&](const auto& row) { return row_allowed(row.first, owner); });
+  if (it == parked.end()) {
+    if (parked.empty())
+      out_of_memory();
+    it = parked.begin();
+    metrics.guard_violations++;
+  }
+  uint64_t frame = take_parked(it);
+  claim_row(frame, cpu);
+  return frame;
 }
 
- uint64_t BuddyAllocator::ppage_allocate(uint64_t cycle, uint64_t vaddr){
+void BuddyAllocator::enable_reservations(std::size_t order)
+{
+  reservation_order = std::min({order, MAX_RESERVATION_ORDER, max_order()});
+}
+
+bool BuddyAllocator::take_reserved(uint64_t page, uint32_t cpu, uint64_t& frame)
+{
+  if (reservation_order == 0 || colored || guarded || randomized)
+    return false;
+
+  uint64_t key = (uint64_t{cpu} << 52) | (page >> reservation_order);
+  auto it = reservations.find(key);
+  if (it == reservations.end()) {
+    // the region's pages are mapped already, a new block would back a page or two and sit unused
+    if (ended_reservations.count(key))
+      return false;
+    if (!can_allocate_block(reservation_order))
+      return false; // too fragmented to reserve, the page is placed on its own
+    it = reservations.emplace(key, reservation{key, allocate_block(reservation_order), 0, {}}).first;
+    reservation_fifo.push_back(key);
+    reserved_frames += 1ull << reservation_order;
+    metrics.reservations++;
+  }
+
+  // a page whose bit is already set was reclaimed and its frame went back to the buddy lists
+  auto offset = page & champsim::bitmask(reservation_order);
+  auto& r = it->second;
+  if (r.populated[offset / 64] & (1ull << (offset % 64)))
+    return false;
+
+  r.populated[offset / 64] |= 1ull << (offset % 64);
+  r.populated_frames++;
+  reserved_frames--;
+  metrics.reserved_faults++;
+  frame = r.block + offset;
+  if (r.populated_frames == (1ull << reservation_order)) {
+    ended_reservations.insert(key);
+    reservations.erase(it);
+  }
+  return true;
+}
+
+void BuddyAllocator::break_reservation()
+{
+  while (!reservations.empty()) {
+    auto it = reservations.find(reservation_fifo.front());
+    reservation_fifo.pop_front();
+    if (it == reservations.end())
+      continue;
+
+    const auto& r = it->second;
+    for (uint64_t offset = 0; offset < (1ull << reservation_order); offset++) {
+      if (!(r.populated[offset / 64] & (1ull << (offset % 64)))) {
+        free_block(r.block + offset, 0);
+        reserved_frames--;
+      }
+    }
+    ended_reservations.insert(it->first);
+    reservations.erase(it);
+    metrics.broken_reservations++;
+    return;
+  }
+}
+
+std::tuple<uint64_t, uint64_t, uint64_t> BuddyAllocator::guard_overhead() const
+{
+  uint64_t guard_rows = 0;
+  std::vector<bool> guard(row_owner.size(), false);
+  for (uint64_t key = 0; key < row_owner.size(); key++) {
+    auto row = key % coloring.rows();
+    if (row == 0 || row + 1 == coloring.rows() || row_owner[key] != 0)
+      continue;
+    if (row_owner[key - 1] != 0 && row_owner[key + 1] != 0 && row_owner[key - 1] != row_owner[key + 1]) {
+      guard[key] = true;
+      guard_rows++;
+    }
+  }
+
+  // rows hold different numbers of frames depending on the mapping, so count the frames themselves
+  uint64_t guard_frames = 0;
+  for (uint64_t frame = first_frame; frame < first_frame + frame_count; frame++)
+    guard_frames += guard[coloring.row_key(frame)];
+
+  uint64_t lost_frames = guard_frames;
+  for (const auto& [key, frames] : parked)
+    if (!guard[key])
+      lost_frames += frames.size();
+  return {guard_rows, guard_frames, lost_frames};
+}
+
+// the color a cpu should take step allocations from now
+std::size_t BuddyAllocator::next_color(const cpu_arena& owner, uint32_t cpu, std::size_t step) const
+{
+  if (!coloring_isolate)
+    return (owner.color_cursor + step) % color_lists.size();
+
+  std::size_t domain = cpu % coloring_domains;
+  std::size_t own_colors = (color_lists.size() - domain + coloring_domains - 1) / coloring_domains;
+  return domain + ((owner.color_cursor + step) % own_colors) * coloring_domains;
+}
+
+uint64_t BuddyAllocator::get_colored_frame(uint64_t pref_frame, bool try_match, uint32_t cpu)
+{
+  auto& owner = arena(cpu);
+
+  // contiguity only wins when the preferred frame has the color the policy would pick anyway
+  if (try_match) {
+    auto color = coloring(pref_frame);
+    bool wanted = coloring_isolate ? color % coloring_domains == cpu % coloring_domains : color == next_color(owner, cpu, 0);
+    if (wanted) {
+      if (color_lists[color].erase(pref_frame)) {
+        cached_frames--;
+        owner.color_cursor++;
+        return pref_frame;
+      }
+      auto [found, block, order] = find_free_block(pref_frame);
+      if (found) {
+        carve_frame(block, order, pref_frame);
+        owner.color_cursor++;
+        return pref_frame;
+      }
+    }
+  }
+
+  std::size_t candidates = coloring_isolate ? (color_lists.size() - cpu % coloring_domains + coloring_domains - 1) / coloring_domains : color_lists.size();
+  for (std::size_t step = 0; step < candidates; step++) {
+    auto& list = color_lists[next_color(owner, cpu, step)];
+    if (list.empty())
+      refill_colors();
+    if (!list.empty()) {
+      uint64_t frame = *list.begin();
+      list.erase(list.begin());
+      cached_frames--;
+      owner.color_cursor += step + 1;
+      return frame;
+    }
+  }
+
+  // every color this cpu may use is gone, take whatever is left
+  metrics.color_fallbacks += coloring_isolate;
+  for (auto& list : color_lists) {
+    if (!list.empty()) {
+      uint64_t frame = *list.begin();
+      list.erase(list.begin());
+      cached_frames--;
+      return frame;
+    }
+  }
+  return allocate_block(0);
+}
+
+// huge extents stay out of the merge indices, so a 4KB neighbour can never grow one past its region
+void BuddyAllocator::index_extent(std::size_t index)
+{
+  const auto& entry = allocated_frame_table[index];
+  if (entry.huge)
+    return;
+  arena(entry.cpu).extent_by_next_page.emplace(entry.start_page + entry.size, index); // the oldest extent keeps a contested page, like the old table scan
+  extent_by_next_frame.emplace(entry.start_frame + entry.size, index);
+}
+
+void BuddyAllocator::unindex_extent(std::size_t index)
+{
+  const auto& entry = allocated_frame_table[index];
+  auto& extent_by_next_page = arena(entry.cpu).extent_by_next_page;
+  if (auto it = extent_by_next_page.find(entry.start_page + entry.size); it != extent_by_next_page.end() && it->second == index)
+    extent_by_next_page.erase(it);
+  if (auto it = extent_by_next_frame.find(entry.start_frame + entry.size); it != extent_by_next_frame.end() && it->second == index)
+    extent_by_next_frame.erase(it);
+}
+
+std::pair<bool,uint64_t> BuddyAllocator::can_merge(uint64_t page, uint32_t cpu){
+  const auto& extent_by_next_page = arena(cpu).extent_by_next_page;
+  auto it = extent_by_next_page.find(page); // looking for the extent of this cpu that ends right before this page
+  if (it != extent_by_next_page.end() && allocated_frame_table[it->second].size < MAX_EXTENT_SIZE){
+    const auto& entry = allocated_frame_table[it->second];
+    return(std::pair<bool,uint64_t>{true,entry.start_frame + entry.size}); // returning the frame that would extend the allocation
+  }
+
+  return(std::pair<bool,uint64_t>{false,0});
+}
+
+uint64_t BuddyAllocator::merging(uint64_t pref_frame, uint64_t cycle){
+
+  auto it = extent_by_next_frame.find(pref_frame); // finding the mergable entry
+  if (it == extent_by_next_frame.end())
+    return (0);
+
+  std::size_t index = it->second;
+  unindex_extent(index);
+  count_extent(allocated_frame_table[index], -1);
+
+  allocated_frame_table[index].size += 1; // incrimenting the size of the entry within the vector by one
+  allocated_frame_table[index].last_access = cycle; //updating the current last accessed to the current cycle 
+
+  index_extent(index);
+  count_extent(allocated_frame_table[index], 1);
+  return (0);
+}
+
+ uint64_t BuddyAllocator::ppage_allocate(uint64_t cycle, uint64_t vaddr, uint32_t cpu){
 
   // not getting to the allocation and we should not be merging the first allocated frame
 
-  auto [found_frame, pref_frame] = can_merge(vaddr>>12); // shifitng our value by 12 bits
+  auto [found_frame, pref_frame] = can_merge(vaddr>>12, cpu); // shifitng our value by 12 bits
 
-  uint64_t real_frame = get_free_frame(pref_frame,found_frame); 
+  uint64_t real_frame;
+  if (!take_reserved(vaddr>>12, cpu, real_frame))
+    real_frame = guarded ? get_guarded_frame(pref_frame, found_frame, cpu) : get_free_frame(pref_frame,found_frame,cpu); 
 
   //allocated_frame_table.push_back({real_frame, 1, vaddr>>12, cycle}); // new entry made if we can not merge the two allocations
 
   //free_frame_table.erase(free_frame_table.begin());
 
-  if ((pref_frame == real_frame) && found_frame){ //checking if the pref_frame and real_frame are the same so that we can merge 
+  last_allocation_merged = (pref_frame == real_frame) && found_frame;
+  metrics.allocations++;
+  metrics.merge_candidates += found_frame;
+  metrics.merges += last_allocation_merged;
+
+  if (last_allocation_merged){ //checking if the pref_frame and real_frame are the same so that we can merge 
 
     merging(pref_frame, cycle);
 
@@ -117,7 +825,11 @@ uint64_t BuddyAllocator::merging(uint64_t pref_frame, uint64_t cycle){
 
   else{ 
 
-  allocated_frame_table.push_back({real_frame, 1, vaddr>>12, cycle}); // new entry made if we can not merge the two allocations
+  allocated_frame_table.push_back({real_frame, 1, vaddr>>12, cpu, false, cycle}); // new entry made if we can not merge the two allocations
+  index_extent(allocated_frame_table.size() - 1);
+  count_extent(allocated_frame_table.back(), 1);
+  if (track_access)
+    extent_by_start_frame[real_frame] = allocated_frame_table.size() - 1;
 
   //free_frame_table.erase(free_frame_table.begin()); // removing the free frame from the free frame vector
   }
@@ -125,43 +837,606 @@ uint64_t BuddyAllocator::merging(uint64_t pref_frame, uint64_t cycle){
   return(real_frame << 12);
  }
 
- uint64_t BuddyAllocator::deallocation(uint64_t cycle, uint64_t index){
+ // with guard rows a page table frame claims its row for the cpu walking it, like any other frame of that cpu
+ uint64_t BuddyAllocator::ppage_allocate_pinned(uint32_t cpu){
+  metrics.pinned_frames++;
+  if (!guarded)
+    return(get_free_frame(0, false, cpu) << 12);
 
-  // iterate through the allocated frames
-  
-    // find the highest/lowest last accssessed values
+  uint64_t frame = get_guarded_frame(0, false, cpu);
+  pinned.push_back({frame, cpu});
+  return(frame << 12);
+ }
 
-  // then deallocate
+ bool BuddyAllocator::can_allocate_block(std::size_t order) const
+ {
+   return std::any_of(std::next(free_lists.begin(), std::min(order, free_lists.size())), free_lists.end(), [](const auto& list) { return !list.empty(); });
+ }
 
-  if (cycle > 10000000) // here we check the cycle count
-  {
-    for (uint64_t i = 0; i < free_frame_table.size(); i++)// need to go through the free frame list and find the first frame number thats bigger than the allocated frame num
-    {
-      if (free_frame_table[i] > allocated_frame_table[index].start_frame)
-      {
-        //TODO loop through and add all frames to free frame table
-        for (size_t j = i; j < allocated_frame_table[index].start_frame + allocated_frame_table[index].size; j++)
-        {
-          free_frame_table.insert(free_frame_table.begin() + j , allocated_frame_table[j].start_frame); // addding the frames back into the free_table _List
+ uint64_t BuddyAllocator::ppage_allocate_huge(uint64_t cycle, uint64_t vaddr, std::size_t order, uint32_t cpu){
+
+  uint64_t block = allocate_block(order);
+  uint64_t start_page = (vaddr >> 12) & ~champsim::bitmask(order); // the region starts on the same alignment as the block
+
+  allocated_frame_table.push_back({block, 1ull << order, start_page, cpu, true, cycle}); // the whole block is one extent
+  if (guarded) // huge blocks are not checked against their neighbours, but 4KB frames of other cpus keep away from them
+    for (uint64_t frame = block; frame < block + (1ull << order); frame++)
+      claim_row(frame, cpu);
+  metrics.huge_allocations++;
+  count_extent(allocated_frame_table.back(), 1);
+  if (track_access)
+    extent_by_start_frame[block] = allocated_frame_table.size() - 1;
+
+  return(block << 12);
+ }
+
+ uint64_t BuddyAllocator::deallocation(uint64_t index){
+
+  auto entry = allocated_frame_table[index];
+  count_extent(entry, -1);
+
+  // once reclaim frees part of a region, its refaults may take a reservation again
+  if (reservation_order > 0)
+    for (uint64_t region = entry.start_page >> reservation_order; region <= (entry.start_page + entry.size - 1) >> reservation_order; region++)
+      ended_reservations.erase((uint64_t{entry.cpu} << 52) | region);
+  if (guarded)
+    for (uint64_t frame = entry.start_frame; frame < entry.start_frame + entry.size; frame++)
+      release_row(frame);
+
+  // returning the frames to the buddy lists as the largest aligned blocks that fit, they merge back into bigger blocks on their own
+  for (uint64_t frame = entry.start_frame; frame < entry.start_frame + entry.size;) {
+    std::size_t order = champsim::lg2(entry.start_frame + entry.size - frame);
+    while (frame & champsim::bitmask(order))
+      order--;
+    free_block(frame, order);
+    frame += 1ull << order;
+  }
+
+  // this will remove the mapping as well as the entry within our allocated table, the last entry moves into its slot
+  unindex_extent(index);
+  if (track_access)
+    extent_by_start_frame.erase(entry.start_frame);
+
+  if (index != allocated_frame_table.size() - 1) {
+    unindex_extent(allocated_frame_table.size() - 1);
+    allocated_frame_table[index] = allocated_frame_table.back();
+    index_extent(index);
+    if (track_access)
+      extent_by_start_frame[allocated_frame_table[index].start_frame] = index;
+  }
+  allocated_frame_table.pop_back();
+
+  return entry.size;
+ }
+
+void BuddyAllocator::enable_access_tracking()
+{
+  track_access = true;
+  for (std::size_t i = 0; i < allocated_frame_table.size(); i++)
+    extent_by_start_frame[allocated_frame_table[i].start_frame] = i;
+}
+
+void BuddyAllocator::touch(uint64_t frame, uint64_t cycle)
+{
+  auto it = extent_by_start_frame.upper_bound(frame);
+  if (it == extent_by_start_frame.begin())
+    return;
+
+  auto& entry = allocated_frame_table[std::prev(it)->second];
+  if (frame < entry.start_frame + entry.size) // frames past the end belong to no extent (page table pages)
+    entry.last_access = cycle;
+}
+
+// CLOCK with last_access standing in for the reference bit: an extent gets a second chance if it was
+// touched since the hand started its previous lap, and a lap that finds nothing moves the reference up to now
+std::size_t BuddyAllocator::select_victim(uint64_t cycle)
+{
+  assert(!allocated_frame_table.empty());
+
+  for (std::size_t steps = 0; steps < 3 * allocated_frame_table.size(); steps++) {
+    if (clock_hand >= allocated_frame_table.size()) {
+      clock_hand = 0;
+      clock_reference = clock_lap_start;
+      clock_lap_start = cycle;
+    }
+
+    if (allocated_frame_table[clock_hand].last_access < clock_reference)
+      return clock_hand; // the hand stays put, the last entry moves into this slot when the victim is removed
+    clock_hand++;
+  }
+
+  // the last lap ran with the reference at cycle, so everything was touched this very cycle and none may go
+  clock_hand %= allocated_frame_table.size();
+  return allocated_frame_table.size();
+}
+
+void BuddyAllocator::write(std::ostream& out) const
+{
+  write_value(out, first_frame);
+  write_value(out, frame_count);
+  write_value(out, uint64_t{randomized});
+  write_value(out, permutation_seed);
+  write_value(out, permutation_cursor);
+  write_value(out, uint64_t{clock_hand});
+  write_value(out, clock_lap_start);
+  write_value(out, clock_reference);
+
+  write_value(out, uint64_t{free_lists.size()});
+  for (const auto& list : free_lists)
+    write_array(out, std::vector<uint64_t>(list.begin(), list.end()));
+  write_array(out, allocated_frame_table);
+
+  write_value(out, uint64_t{arenas.size()});
+  for (const auto& owner : arenas) {
+    write_value(out, owner.color_cursor);
+    write_array(out, owner.cache);
+    write_array(out, owner.parked_rows);
+  }
+  write_value(out, uint64_t{color_lists.size()});
+  for (const auto& list : color_lists)
+    write_array(out, std::vector<uint64_t>(list.begin(), list.end()));
+
+  // row ownership follows from the extent table and the page table frames, only the parked frames need saving too
+  std::vector<checkpoint_parked> parked_list;
+  for (const auto& [row, frames] : parked)
+    for (auto frame : frames)
+      parked_list.push_back({row, frame});
+  write_array(out, parked_list);
+  write_array(out, pinned);
+
+  std::vector<reservation> reservation_list;
+  for (auto key : reservation_fifo)
+    if (auto it = reservations.find(key); it != reservations.end())
+      reservation_list.push_back(it->second);
+  write_value(out, uint64_t{reservation_order});
+  write_array(out, reservation_list);
+  std::vector<uint64_t> ended_list(ended_reservations.begin(), ended_reservations.end());
+  std::sort(ended_list.begin(), ended_list.end()); // the same state writes the same file
+  write_array(out, ended_list);
+}
+
+void BuddyAllocator::read(std::istream& in)
+{
+  uint64_t saved_first, saved_count, saved_randomized, saved_hand, orders;
+  read_value(in, saved_first);
+  read_value(in, saved_count);
+  if (saved_first != first_frame || saved_count != frame_count)
+    throw std::runtime_error("VMEM checkpoint was taken with a different physical memory size");
+
+  read_value(in, saved_randomized);
+  read_value(in, permutation_seed);
+  read_value(in, permutation_cursor);
+  randomized = saved_randomized;
+  if (randomized)
+    permutation = FramePermutation{frame_count, permutation_seed};
+  read_value(in, saved_hand);
+  clock_hand = saved_hand;
+  read_value(in, clock_lap_start);
+  read_value(in, clock_reference);
+
+  read_value(in, orders);
+  if (orders != free_lists.size())
+    throw std::runtime_error("VMEM checkpoint has a different number of buddy orders");
+
+  free_frames = 0;
+  std::vector<uint64_t> blocks;
+  for (std::size_t order = 0; order < free_lists.size(); order++) {
+    read_array(in, blocks);
+    free_lists[order] = std::set<uint64_t>(blocks.begin(), blocks.end()); // sorted input, so this is linear
+    free_frames += blocks.size() << order;
+  }
+
+  read_array(in, allocated_frame_table);
+
+  uint64_t arena_count;
+  read_value(in, arena_count);
+  arenas.assign(arena_count, {});
+  cached_frames = 0;
+  for (auto& owner : arenas) {
+    read_value(in, owner.color_cursor);
+    read_array(in, owner.cache);
+    read_array(in, owner.parked_rows);
+    cached_frames += owner.cache.size();
+  }
+
+  uint64_t color_count;
+  read_value(in, color_count);
+  if (color_count != color_lists.size())
+    throw std::runtime_error("VMEM checkpoint was taken with a different page coloring");
+  for (auto& list : color_lists) {
+    read_array(in, blocks);
+    list = std::set<uint64_t>(blocks.begin(), blocks.end());
+    cached_frames += blocks.size();
+  }
+
+  std::vector<checkpoint_parked> parked_list;
+  read_array(in, parked_list);
+  parked.clear();
+  for (auto [row, frame] : parked_list)
+    parked[row].push_back(frame);
+  parked_frames = parked_list.size();
+  read_array(in, pinned);
+
+  uint64_t saved_reservation_order;
+  std::vector<reservation> reservation_list;
+  read_value(in, saved_reservation_order);
+  read_array(in, reservation_list);
+  std::vector<uint64_t> ended_list;
+  read_array(in, ended_list);
+  if ((!reservation_list.empty() || !ended_list.empty()) && saved_reservation_order != reservation_order)
+    throw std::runtime_error("VMEM checkpoint was taken with a different reservation size");
+  reservations.clear();
+  reservation_fifo.clear();
+  reserved_frames = 0;
+  for (const auto& r : reservation_list) {
+    reservations.emplace(r.key, r);
+    reservation_fifo.push_back(r.key);
+    reserved_frames += (1ull << reservation_order) - r.populated_frames;
+  }
+  ended_reservations = std::unordered_set<uint64_t>(ended_list.begin(), ended_list.end());
+  if (guarded) {
+    std::fill(row_owner.begin(), row_owner.end(), 0);
+    std::fill(row_frames.begin(), row_frames.end(), 0);
+    for (const auto& entry : allocated_frame_table)
+      for (uint64_t frame = entry.start_frame; frame < entry.start_frame + entry.size; frame++)
+        claim_row(frame, entry.cpu);
+    for (auto [frame, cpu] : pinned)
+      claim_row(frame, static_cast<uint32_t>(cpu));
+  }
+
+  extent_by_next_frame.clear();
+  extent_by_start_frame.clear();
+  // the extent metrics follow from the table; whatever is neither free nor in an extent holds page tables
+  metrics = {};
+  uint64_t extent_frames = 0;
+  for (std::size_t i = 0; i < allocated_frame_table.size(); i++) {
+    index_extent(i);
+    count_extent(allocated_frame_table[i], 1);
+    extent_frames += allocated_frame_table[i].size;
+  }
+  metrics.pinned_frames = frame_count - free_frames - cached_frames - parked_frames - reserved_frames - extent_frames;
+
+  if (track_access)
+    enable_access_tracking();
+}
+
+void FlatPageMap::reserve(std::size_t expected_size)
+{
+  std::size_t capacity = 16;
+  while (capacity * 7 / 10 < expected_size) // keep the load factor under 70%
+    capacity *= 2;
+  if (capacity > slots.size())
+    rehash(capacity);
+}
+
+void FlatPageMap::rehash(std::size_t capacity)
+{
+  std::vector<slot> old_slots(capacity, slot{EMPTY_KEY, 0});
+  std::swap(slots, old_slots);
+  index_bits = champsim::lg2(capacity);
+
+  for (const auto& s : old_slots) {
+    if (s.key == EMPTY_KEY)
+      continue;
+    auto index = home(s.key);
+    while (slots[index].key != EMPTY_KEY)
+      index = next(index);
+    slots[index] = s;
+  }
+}
+
+const uint64_t* FlatPageMap::find(uint64_t key) const
+{
+  for (auto index = home(key);; index = next(index)) {
+    if (slots[index].key == key)
+      return &slots[index].value;
+    if (slots[index].key == EMPTY_KEY)
+      return nullptr;
+  }
+}
+
+std::pair<uint64_t*, bool> FlatPageMap::try_emplace(uint64_t key, uint64_t value)
+{
+  assert(key != EMPTY_KEY);
+  if ((occupied + 1) * 10 > slots.size() * 7)
+    rehash(slots.size() * 2);
+
+  auto index = home(key);
+  for (; slots[index].key != EMPTY_KEY; index = next(index)) {
+    if (slots[index].key == key)
+      return {&slots[index].value, false};
+  }
+
+  slots[index] = {key, value};
+  occupied++;
+  return {&slots[index].value, true};
+}
+
+// backward-shift deletion, so no tombstones build up in long runs
+bool FlatPageMap::erase(uint64_t key)
+{
+  auto index = home(key);
+  for (; slots[index].key != key; index = next(index)) {
+    if (slots[index].key == EMPTY_KEY)
+      return false;
+  }
+
+  for (auto hole = index, probe = next(index);; probe = next(probe)) {
+    if (slots[probe].key == EMPTY_KEY) {
+      slots[hole].key = EMPTY_KEY;
+      break;
+    }
+
+    // an entry may only move back if the hole sits between its home slot and where it is now
+    auto ideal = home(slots[probe].key);
+    if (((probe - ideal) & (slots.size() - 1)) >= ((probe - hole) & (slots.size() - 1))) {
+      slots[hole] = slots[probe];
+      hole = probe;
+    }
+  }
+
+  occupied--;
+  return true;
+}
+
+void FlatPageMap::write(std::ostream& out) const
+{
+  write_value(out, uint64_t{occupied});
+  write_array(out, slots);
+}
+
+void FlatPageMap::read(std::istream& in)
+{
+  uint64_t saved_occupied;
+  read_value(in, saved_occupied);
+  read_array(in, slots);
+  if (slots.empty() || slots.size() != (1ull << champsim::lg2(slots.size())))
+    throw std::runtime_error("VMEM checkpoint has a malformed page map");
+  occupied = saved_occupied;
+  index_bits = champsim::lg2(slots.size());
+}
+
+void AdjacencyIndex::insert(uint64_t frame, uint32_t cpu, uint64_t vpage)
+{
+  residents_by_row[rows.row_key(frame)].push_back({frame, FlatPageMap::pack(cpu, vpage)});
+}
+
+void AdjacencyIndex::erase(uint64_t frame)
+{
+  auto it = residents_by_row.find(rows.row_key(frame));
+  if (it == residents_by_row.end())
+    return;
+
+  auto& residents = it->second;
+  auto resident = std::find_if(residents.begin(), residents.end(), [frame](const auto& r) { return r.frame == frame; });
+  if (resident != residents.end()) {
+    *resident = residents.back();
+    residents.pop_back();
+  }
+  if (residents.empty())
+    residents_by_row.erase(it);
+}
+
+void AdjacencyIndex::erase(uint64_t frame, uint32_t cpu)
+{
+  auto it = residents_by_row.find(rows.row_key(frame));
+  if (it == residents_by_row.end())
+    return;
+
+  auto& residents = it->second;
+  auto resident = std::find_if(residents.begin(), residents.end(),
+                               [frame, cpu](const auto& r) { return r.frame == frame && (r.owner >> FlatPageMap::CPU_SHIFT) == cpu; });
+  if (resident != residents.end()) {
+    *resident = residents.back();
+    residents.pop_back();
+  }
+  if (residents.empty())
+    residents_by_row.erase(it);
+}
+
+std::vector<AdjacencyIndex::neighbour> AdjacencyIndex::cross_domain(const dram_coordinates& where, uint32_t cpu) const
+{
+  std::vector<neighbour> result;
+  auto key = rows.row_key(where);
+  for (uint64_t distance = 1; distance <= MAX_DISTANCE; distance++) {
+    for (auto neighbour_row : {where.row - distance, where.row + distance}) {
+      if (neighbour_row >= rows.rows()) // also catches rows below 0, which wrapped around
+        continue;
+      auto it = residents_by_row.find(key - where.row + neighbour_row);
+      if (it == residents_by_row.end())
+        continue;
+      for (auto [frame, owner] : it->second) {
+        auto owner_cpu = static_cast<uint32_t>(owner >> FlatPageMap::CPU_SHIFT);
+        if (owner_cpu != cpu)
+          result.push_back({owner_cpu, owner & champsim::bitmask(FlatPageMap::CPU_SHIFT), frame, distance});
+      }
+    }
+  }
+  return result;
+}
+
+std::vector<AdjacencyIndex::neighbour> AdjacencyIndex::cross_domain(uint64_t frame, uint32_t cpu) const
+{
+  return cross_domain(rows.coordinates(frame), cpu);
+}
+
+std::array<uint64_t, AdjacencyIndex::MAX_DISTANCE + 1> AdjacencyIndex::report(std::ostream* out) const
+{
+  std::vector<uint64_t> keys;
+  for (const auto& [key, residents] : residents_by_row)
+    keys.push_back(key);
+  std::sort(keys.begin(), keys.end());
+
+  if (out)
+    *out << "bank_color,row,cpu,vpage,frame,neighbour_row,neighbour_cpu,neighbour_vpage,neighbour_frame,distance\n";
+
+  // only look upwards, so every pair is seen from its lower row exactly once
+  std::array<uint64_t, MAX_DISTANCE + 1> pairs{};
+  for (auto key : keys) {
+    auto row = key % rows.rows();
+    for (uint64_t distance = 1; distance <= MAX_DISTANCE && row + distance < rows.rows(); distance++) {
+      auto it = residents_by_row.find(key + distance);
+      if (it == residents_by_row.end())
+        continue;
+      for (auto low : residents_by_row.at(key)) {
+        for (auto high : it->second) {
+          if ((low.owner >> FlatPageMap::CPU_SHIFT) == (high.owner >> FlatPageMap::CPU_SHIFT))
+            continue;
+          pairs[distance]++;
+          if (out)
+            *out << fmt::format("{},{},{},{:#x},{:#x},{},{},{:#x},{:#x},{}\n", key / rows.rows(), row, low.owner >> FlatPageMap::CPU_SHIFT,
+                                low.owner & champsim::bitmask(FlatPageMap::CPU_SHIFT), low.frame, row + distance, high.owner >> FlatPageMap::CPU_SHIFT,
+                                high.owner & champsim::bitmask(FlatPageMap::CPU_SHIFT), high.frame, distance);
         }
-        
-      } 
-      
+      }
     }
+  }
+  return pairs;
+}
+
+RadixPageTable::RadixPageTable(std::size_t page_table_levels, uint64_t pte_page_size)
+    : levels(page_table_levels), index_bits(champsim::lg2(pte_page_size / PTE_BYTES)), fanout(pte_page_size / PTE_BYTES),
+      inner_entries(fanout, 0), inner_children(fanout, NO_NODE), leaf_entries(fanout, 0)
+{
+}
 
-    allocated_frame_table.erase(allocated_frame_table.begin() + index); // this will remove the mapping as well as the entry within our allocated table
+uint32_t RadixPageTable::new_node(std::size_t level)
+{
+  if (level == 1) {
+    leaf_entries.resize(leaf_entries.size() + fanout, 0);
+    return static_cast<uint32_t>(leaf_entries.size() / fanout - 1);
   }
-  
- }
+
+  inner_entries.resize(inner_entries.size() + fanout, 0);
+  inner_children.resize(inner_children.size() + fanout, NO_NODE);
+  return static_cast<uint32_t>(inner_entries.size() / fanout - 1);
+}
+
+uint64_t& RadixPageTable::entry(uint64_t vaddr, std::size_t level)
+{
+  auto top_shift = shamt(levels + 1);
+  uint64_t root_key = top_shift < 64 ? vaddr >> top_shift : 0;
+
+  auto [root, inserted] = roots.try_emplace(root_key, NO_NODE);
+  if (inserted)
+    root->second = new_node(levels);
+
+  uint32_t node = root->second;
+  for (std::size_t current = levels; current > level; current--) {
+    auto index = node * fanout + offset(vaddr, current);
+    if (inner_children[index] == NO_NODE) {
+      auto child = new_node(current - 1); // may grow the pools, so index again afterwards
+      inner_children[index] = child;
+    }
+    node = inner_children[index];
+  }
+
+  auto index = node * fanout + offset(vaddr, level);
+  return level == 1 ? leaf_entries[index] : inner_entries[index];
+}
+
+void RadixPageTable::write(std::ostream& out) const
+{
+  std::vector<checkpoint_root> root_list;
+  for (auto [key, node] : roots)
+    root_list.push_back({key, node});
+  write_array(out, root_list);
+  write_array(out, inner_entries);
+  write_array(out, inner_children);
+  write_array(out, leaf_entries);
+}
+
+void RadixPageTable::read(std::istream& in)
+{
+  std::vector<checkpoint_root> root_list;
+  read_array(in, root_list);
+  roots.clear();
+  for (auto [key, node] : root_list)
+    roots.emplace(key, static_cast<uint32_t>(node));
+
+  read_array(in, inner_entries);
+  read_array(in, inner_children);
+  read_array(in, leaf_entries);
+}
 
 //constructor, what is called whren vmem starts up
-VirtualMemory::VirtualMemory(uint64_t page_table_page_size, std::size_t page_table_levels, uint64_t minor_penalty, MEMORY_CONTROLLER& _dram)
-    : next_ppage(0), last_ppage(1ull << (LOG2_PAGE_SIZE + champsim::lg2(page_table_page_size / PTE_BYTES) * page_table_levels)),
-      minor_fault_penalty(minor_penalty), pt_levels(page_table_levels), pte_page_size(page_table_page_size),pmem_size(_dram.size()), dram(_dram),
-      BA(VMEM_RESERVE_CAPACITY/PAGE_SIZE,_dram.size()/PAGE_SIZE) // calling the Buddy Allocator constructor here
+VirtualMemory::VirtualMemory(uint64_t page_table_page_size, std::size_t page_table_levels, uint64_t minor_penalty, MEMORY_CONTROLLER& _dram, VirtualMemoryConfig cfg)
+    : next_ppage(0), last_ppage(1ull << (LOG2_PAGE_SIZE + champsim::lg2(page_table_page_size / PTE_BYTES) * page_table_levels)), dram(_dram),
+      virtual_seed(cfg.virtual_seed), pmem_size(_dram.size()), minor_fault_penalty(minor_penalty), pt_levels(page_table_levels),
+      pte_page_size(page_table_page_size), config(cfg)
 {
+  // one Buddy Allocator per node, the first node starts after the reserved frames
+  if (config.numa_nodes == 0 || (pmem_size / PAGE_SIZE) / config.numa_nodes <= VMEM_RESERVE_CAPACITY / PAGE_SIZE)
+    throw std::runtime_error(fmt::format("VMEM cannot split {} bytes of physical memory into {} nodes", pmem_size, config.numa_nodes));
+  for (auto node : config.cpu_nodes)
+    if (node >= config.numa_nodes)
+      throw std::runtime_error(fmt::format("VMEM cpu_nodes names node {} of {}", node, config.numa_nodes));
+  if (config.numa_nodes > 1 && config.guard_rows)
+    throw std::runtime_error("VMEM guard rows only see the rows of one node and cannot be combined with several NUMA nodes");
+  frames_per_node = (pmem_size / PAGE_SIZE) / config.numa_nodes;
+  nodes.reserve(config.numa_nodes);
+  for (uint64_t node = 0; node < config.numa_nodes; node++)
+    nodes.emplace_back(node == 0 ? VMEM_RESERVE_CAPACITY / PAGE_SIZE : node * frames_per_node,
+                       node + 1 == config.numa_nodes ? pmem_size / PAGE_SIZE : (node + 1) * frames_per_node);
+  if (config.numa_nodes > 1)
+    sim_stats.translations_by_node.resize(config.numa_nodes, 0);
+
+  // start with room for 1/16th of physical memory so short runs never rehash and long ones rehash a handful of times
+  vpage_to_ppage_map.reserve(pmem_size / PAGE_SIZE / 16);
 
   assert(page_table_page_size > 1024);
+  assert(!config.huge_pages || pt_levels >= HUGE_LEAF_LEVEL);
+  assert(config.walk_cache_sets == (1ull << champsim::lg2(config.walk_cache_sets)) || config.walk_cache_sets == 0);
+  sim_stats.walk_cache_hits.resize(pt_levels + 1, 0);
+  sim_stats.walk_cache_misses.resize(pt_levels + 1, 0);
+  for (auto& node : nodes) {
+    if (config.reclaim)
+      node.enable_access_tracking();
+    if (config.cpu_arena_batch_order > 0)
+      node.enable_cpu_arenas(config.cpu_arena_batch_order);
+    if (config.reservation_order > 0)
+      node.enable_reservations(config.reservation_order);
+  }
+  if (config.page_coloring || config.guard_rows || config.adjacency_index) {
+    if (config.dram_mapper.empty())
+      throw std::runtime_error("VMEM page coloring, guard rows and the adjacency index need config.dram_mapper");
+    FrameColoring frame_coloring{parse_dram_mapping(config.dram_mapper), config.geometry};
+    for (auto& node : nodes) {
+      if (config.page_coloring)
+        node.enable_coloring(frame_coloring, config.coloring_isolate, config.coloring_domains);
+      if (config.guard_rows)
+        node.enable_guard_rows(frame_coloring);
+    }
+    if (config.adjacency_index)
+      adjacency = std::make_unique<AdjacencyIndex>(frame_coloring);
+  }
+  if (sharing()) {
+    if (config.reclaim || config.huge_pages)
+      throw std::runtime_error("VMEM page sharing cannot be combined with reclaim or huge pages");
+    for (uint32_t group = 0; group < config.identical_cpus.size(); group++) {
+      for (auto cpu : config.identical_cpus[group]) {
+        if (cpu >= sharing_group_of.size())
+          sharing_group_of.resize(cpu + 1, NOT_SHARED);
+        sharing_group_of[cpu] = group;
+      }
+    }
+  }
+  shuffle_pages();
+
+  if (!config.metrics_file.empty()) {
+    metrics_out = std::make_unique<std::ofstream>(config.metrics_file);
+    if (!*metrics_out)
+      throw std::runtime_error(fmt::format("Unable to open VMEM metrics file {}", config.metrics_file));
+  }
+  next_metrics_epoch = config.metrics_epoch;
+
+  if constexpr (vmem_event_trace) {
+    if (!config.event_trace.empty())
+      events = std::make_unique<VmemEventRecorder>(config.event_trace);
+  }
+
+  if (!config.checkpoint_restore.empty())
+    load_checkpoint(config.checkpoint_restore);
   assert(page_table_page_size == (1ull << champsim::lg2(page_table_page_size)));
   assert(last_ppage > VMEM_RESERVE_CAPACITY);
 
@@ -173,31 +1448,317 @@ VirtualMemory::VirtualMemory(uint64_t page_table_page_size, std::size_t page_tab
 
 }
 
+VirtualMemory::~VirtualMemory()
+{
+  if (config.print_stats_on_exit)
+    print_stats();
+
+  // a destructor must not throw, so a report that cannot be written only costs a warning
+  try {
+    finish();
+  } catch (const std::exception& e) {
+    fmt::print("WARNING: {}\n", e.what());
+  }
+}
+
+void VirtualMemory::end_warmup()
+{
+  if (!config.checkpoint_save.empty())
+    save_checkpoint(config.checkpoint_save);
+}
+
+void VirtualMemory::finish()
+{
+  if (final_written)
+    return;
+  final_written = true;
+  write_metrics("final", dram.current_cycle);
+  write_adjacency_report();
+}
+
+namespace
+{
+template <typename Container>
+std::string json_array(const Container& values)
+{
+  std::string result = "[";
+  for (auto it = std::begin(values); it != std::end(values); ++it)
+    result += fmt::format("{}{}", it == std::begin(values) ? "" : ",", *it);
+  return result + "]";
+}
+} // namespace
+
+// faults of either page size check the epoch, so a run of huge faults still gets its snapshots
+void VirtualMemory::write_epoch_metrics()
+{
+  if (config.metrics_epoch > 0 && dram.current_cycle >= next_metrics_epoch) {
+    write_metrics("epoch", dram.current_cycle);
+    next_metrics_epoch = dram.current_cycle + config.metrics_epoch;
+  }
+}
+
+// one JSON object per line, so epoch snapshots can be appended as the run goes
+void VirtualMemory::write_metrics(const char* phase, uint64_t cycle) const
+{
+  if (!metrics_out)
+    return;
+
+  auto summary = summarize_nodes();
+  const auto& m = summary.metrics;
+  std::vector<uint64_t> free_frames_by_node, allocations_by_node;
+  for (const auto& node : nodes) {
+    free_frames_by_node.push_back(node.available_frames());
+    allocations_by_node.push_back(node.metrics.allocations);
+  }
+
+  *metrics_out << fmt::format("{{\"phase\":\"{}\",\"cycle\":{},\"free_frames\":{},\"free_blocks_by_order\":{},\"largest_free_block_frames\":{},"
+                              "\"extents\":{},\"extent_size_histogram\":{},\"allocations\":{},\"merge_candidates\":{},\"merges\":{},"
+                              "\"huge_allocations\":{},\"pinned_frames\":{},\"frames_by_cpu\":{},\"color_fallbacks\":{},\"parked_frames\":{},"
+                              "\"guard_rejections\":{},\"guard_violations\":{},\"reservations\":{},\"reserved_faults\":{},\"broken_reservations\":{},"
+                              "\"reserved_frames\":{},\"shared_faults\":{},\"cow_copies\":{},\"shared_frames\":{},\"free_frames_by_node\":{},"
+                              "\"allocations_by_node\":{},\"translations_by_node\":{},\"remote_translations\":{}}}\n",
+                              phase, cycle, summary.free_frames, json_array(summary.free_blocks), summary.largest_free_block, summary.extents,
+                              json_array(m.extent_size_histogram), m.allocations, m.merge_candidates, m.merges, m.huge_allocations, m.pinned_frames,
+                              json_array(m.frames_by_cpu), m.color_fallbacks, summary.parked_frames, m.guard_rejections, m.guard_violations, m.reservations,
+                              m.reserved_faults, m.broken_reservations, summary.reserved_frames, sim_stats.shared_faults, sim_stats.cow_copies,
+                              frame_references.size(), json_array(free_frames_by_node), json_array(allocations_by_node),
+                              json_array(sim_stats.translations_by_node), sim_stats.remote_translations);
+  metrics_out->flush();
+}
+
+uint64_t VirtualMemory::dram_cycle() const { return dram.current_cycle; }
+
+VmemEventRecorder::VmemEventRecorder(const std::string& path, std::size_t capacity) : ring(capacity), file(std::fopen(path.c_str(), "wb"))
+{
+  assert(capacity == (1ull << champsim::lg2(capacity)));
+  if (file == nullptr)
+    throw std::runtime_error(fmt::format("Unable to open VMEM event trace {}", path));
+
+  vmem_event_file_header header;
+  std::fwrite(&header, sizeof(header), 1, file);
+  writer = std::thread{&VmemEventRecorder::drain, this};
+}
+
+VmemEventRecorder::~VmemEventRecorder()
+{
+  stopping.store(true, std::memory_order_release);
+  writer.join();
+  std::fclose(file);
+}
+
+// writes whatever the producer has published, in at most two pieces when the ring wraps
+void VmemEventRecorder::drain()
+{
+  while (true) {
+    auto start = tail.load(std::memory_order_relaxed);
+    auto end = head.load(std::memory_order_acquire);
+
+    if (start == end) {
+      if (stopping.load(std::memory_order_acquire) && head.load(std::memory_order_acquire) == start)
+        return;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    auto first = start & (ring.size() - 1);
+    auto count = std::min<uint64_t>(end - start, ring.size() - first);
+    std::fwrite(&ring[first], sizeof(vmem_event), count, file);
+    tail.store(start + count, std::memory_order_release);
+  }
+}
+
+void VirtualMemory::print_stats() const
+{
+  auto summary = summarize_nodes();
+  const auto& m = summary.metrics;
+  fmt::print("VMEM free frames: {} largest free block: {} frames extents: {} merges: {} of {} allocations ({} candidates)\n", summary.free_frames,
+             summary.largest_free_block, summary.extents, m.merges, m.allocations, m.merge_candidates);
+  fmt::print("VMEM free blocks by order: {}\n", json_array(summary.free_blocks));
+  fmt::print("VMEM extent size histogram (log2 frames): {}\n", json_array(m.extent_size_histogram));
+  fmt::print("VMEM frames by cpu: {} page table frames: {}\n", json_array(m.frames_by_cpu), m.pinned_frames);
+  if (config.reservation_order > 0)
+    fmt::print("VMEM reservations: {} made, {} faults served from them, {} broken, {} reserved frames unused\n", m.reservations, m.reserved_faults,
+               m.broken_reservations, summary.reserved_frames);
+  if (config.page_coloring)
+    fmt::print("VMEM page coloring: {} colors from {} bank bits, isolation fallbacks: {}\n", nodes.front().colors(), config.dram_mapper, m.color_fallbacks);
+  if (config.guard_rows) {
+    auto [guard_rows, guard_frames, lost_frames] = nodes.front().guard_overhead();
+    fmt::print("VMEM guard rows: {} holding {} frames, {} frames lost with the parked ones ({:.3}% of memory) parked frames: {} rejections: {} violations: {}\n",
+               guard_rows, guard_frames, lost_frames, 100.0 * lost_frames / (pmem_size >> LOG2_PAGE_SIZE), summary.parked_frames, m.guard_rejections,
+               m.guard_violations);
+  }
+  if (adjacency) {
+    auto pairs = adjacency->report(nullptr);
+    fmt::print("VMEM cross-domain row pairs: {} at distance 1, {} at distance 2\n", pairs[1], pairs[2]);
+  }
+  if (nodes.size() > 1) {
+    for (std::size_t node = 0; node < nodes.size(); node++)
+      fmt::print("VMEM node {} free frames: {} allocations: {} frames by cpu: {} translations: {}\n", node, nodes[node].available_frames(),
+                 nodes[node].metrics.allocations, json_array(nodes[node].metrics.frames_by_cpu), sim_stats.translations_by_node[node]);
+    uint64_t translations = 0;
+    for (auto count : sim_stats.translations_by_node)
+      translations += count;
+    fmt::print("VMEM remote translations: {} of {} ({:.4g}%)\n", sim_stats.remote_translations, translations,
+               translations > 0 ? 100.0 * sim_stats.remote_translations / translations : 0.0);
+  }
+
+  if (sharing())
+    fmt::print("VMEM shared pages: {} faults mapped a frame already shared, {} copy-on-write copies, {} frames shared now\n", sim_stats.shared_faults,
+               sim_stats.cow_copies, frame_references.size());
+  if (config.reclaim)
+    fmt::print("VMEM reclaim batches: {} reclaimed frames: {} major faults: {}\n", sim_stats.reclaim_batches, sim_stats.reclaimed_frames, sim_stats.major_faults);
+  if (config.huge_pages)
+    fmt::print("VMEM huge page faults: {} regions paged at 4KB: {}\n", sim_stats.huge_faults, sim_stats.split_regions);
+  if (config.translation_memo)
+    fmt::print("VMEM translation memo hits: {} misses: {}\n", sim_stats.memo_hits, sim_stats.memo_misses);
+
+  if (config.walk_cache_sets > 0) {
+    for (std::size_t level = pt_levels; level > 0; level--) {
+      auto hits = sim_stats.walk_cache_hits[level];
+      auto total = hits + sim_stats.walk_cache_misses[level];
+      fmt::print("VMEM walk cache level {} hits: {} misses: {} hit rate: {:.4g}\n", level, hits, sim_stats.walk_cache_misses[level],
+                 total > 0 ? static_cast<double>(hits) / static_cast<double>(total) : 0.0);
+    }
+  }
+}
+
+void VirtualMemory::write_adjacency_report() const
+{
+  if (!adjacency || config.adjacency_report.empty())
+    return;
+
+  std::ofstream out(config.adjacency_report);
+  if (!out)
+    throw std::runtime_error(fmt::format("Unable to open VMEM adjacency report {}", config.adjacency_report));
+  adjacency->report(&out);
+}
+
+VirtualMemory::allocator_summary VirtualMemory::summarize_nodes() const
+{
+  allocator_summary summary;
+  for (const auto& node : nodes) {
+    summary.metrics += node.metrics;
+    summary.free_frames += node.available_frames();
+    if (node.max_order() + 1 > summary.free_blocks.size())
+      summary.free_blocks.resize(node.max_order() + 1, 0);
+    for (std::size_t order = 0; order <= node.max_order(); order++)
+      summary.free_blocks[order] += node.free_blocks(order);
+    auto largest = node.largest_free_order();
+    if (largest <= node.max_order())
+      summary.largest_free_block = std::max<uint64_t>(summary.largest_free_block, 1ull << largest);
+    summary.extents += node.allocated_frame_table.size();
+    summary.parked_frames += node.parked_count();
+    summary.reserved_frames += node.reserved_count();
+  }
+  return summary;
+}
+
+void VirtualMemory::add_cpu(uint32_t cpu_num)
+{
+  page_table.resize(cpu_num + 1, RadixPageTable{pt_levels, pte_page_size});
+  walk_cache.resize(cpu_num + 1, std::vector<walk_cache_line>(config.walk_cache_sets * pt_levels));
+  translation_memo.resize(cpu_num + 1);
+  next_pte_page.resize(cpu_num + 1, 0);
+}
+
+void VirtualMemory::save_checkpoint(const std::string& path) const
+{
+  std::ofstream out(path, std::ios::binary);
+  if (!out)
+    throw std::runtime_error(fmt::format("Unable to open VMEM checkpoint {} for writing", path));
+
+  write_value(out, checkpoint_header{CHECKPOINT_MAGIC, CHECKPOINT_VERSION, PAGE_SIZE, pmem_size, pt_levels, pte_page_size, config.huge_pages, page_table.size()});
+  write_value(out, uint64_t{nodes.size()});
+  for (const auto& node : nodes)
+    node.write(out);
+  vpage_to_ppage_map.write(out);
+  huge_page_map.write(out);
+  swapped_pages.write(out);
+  swapped_regions.write(out);
+  shared_pages.write(out);
+  frame_references.write(out);
+  write_array(out, next_pte_page);
+  for (const auto& table : page_table)
+    table.write(out);
+
+  fmt::print("VMEM checkpoint saved to {}: {} mappings, {} extents\n", path, vpage_to_ppage_map.size() + huge_page_map.size(), summarize_nodes().extents);
+}
+
+void VirtualMemory::load_checkpoint(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    throw std::runtime_error(fmt::format("Unable to open VMEM checkpoint {}", path));
+
+  checkpoint_header header;
+  read_value(in, header);
+  if (header.magic != CHECKPOINT_MAGIC)
+    throw std::runtime_error(fmt::format("{} is not a VMEM checkpoint", path));
+  if (header.version != CHECKPOINT_VERSION)
+    throw std::runtime_error(fmt::format("VMEM checkpoint {} has version {}, expected {}", path, header.version, CHECKPOINT_VERSION));
+  if (header.page_size != PAGE_SIZE || header.pmem_size != pmem_size || header.pt_levels != pt_levels || header.pte_page_size != pte_page_size
+      || header.huge_pages != config.huge_pages)
+    throw std::runtime_error(fmt::format("VMEM checkpoint {} was taken with a different memory configuration", path));
+
+  uint64_t node_count;
+  read_value(in, node_count);
+  if (node_count != nodes.size())
+    throw std::runtime_error(fmt::format("VMEM checkpoint {} has {} NUMA nodes, expected {}", path, node_count, nodes.size()));
+  for (auto& node : nodes)
+    node.read(in);
+  vpage_to_ppage_map.read(in);
+  huge_page_map.read(in);
+  swapped_pages.read(in);
+  swapped_regions.read(in);
+  shared_pages.read(in);
+  frame_references.read(in);
+  read_array(in, next_pte_page);
+
+  // the caches only ever hold what the tables say, so they simply start cold
+  page_table.clear();
+  walk_cache.clear();
+  translation_memo.clear();
+  if (header.cpus > 0)
+    add_cpu(static_cast<uint32_t>(header.cpus - 1));
+  for (auto& table : page_table)
+    table.read(in);
+
+  if (adjacency) {
+    adjacency->clear();
+    if (sharing()) { // a shared frame is resident once for every cpu mapping it, which only the page map knows
+      vpage_to_ppage_map.for_each([this](uint64_t key, uint64_t ppage) {
+        adjacency->insert(ppage >> LOG2_PAGE_SIZE, static_cast<uint32_t>(key >> FlatPageMap::CPU_SHIFT), key & champsim::bitmask(FlatPageMap::CPU_SHIFT));
+      });
+    } else {
+      for (const auto& node : nodes)
+        for (std::size_t i = 0; i < node.allocated_frame_table.size(); i++)
+          index_extent_pages(node, i);
+    }
+  }
+
+  fmt::print("VMEM checkpoint restored from {}: {} mappings, {} extents\n", path, vpage_to_ppage_map.size() + huge_page_map.size(), summarize_nodes().extents);
+}
+
 // randomizes pages in the page list
+// no list is built, the allocator walks a Feistel permutation keyed by the seed, so this is constant time and memory
 void VirtualMemory::shuffle_pages()
 {
 
   if(virtual_seed != 0)
   {
-    std::mt19937_64 rng(virtual_seed);
-    std::shuffle(ppage_free_list.begin(),ppage_free_list.end(),rng);
-    fmt::print("Shuffled {} physical pages with seed {}\n",ppage_free_list.size(),virtual_seed);
+    for (auto& node : nodes)
+      node.randomize(virtual_seed);
+    fmt::print("Shuffled {} physical pages with seed {}\n",(pmem_size - VMEM_RESERVE_CAPACITY)/PAGE_SIZE,virtual_seed);
   }
 }
 
-// refilling the page list if it's empty and reshuffles the pages 
+// the permutation covers every physical page, so refilling only means starting it over
 void VirtualMemory::populate_pages()
 {
-
-  ppage_free_list.resize((pmem_size - VMEM_RESERVE_CAPACITY)/PAGE_SIZE);
-  uint64_t base_address = VMEM_RESERVE_CAPACITY;
-  for(auto it = ppage_free_list.begin(); it != ppage_free_list.end(); it++)
-  {
-    *(it) = base_address;
-    base_address += PAGE_SIZE;
-  }
-  fmt::print("Created {} new physical pages\n",ppage_free_list.size());
+  for (auto& node : nodes)
+    node.restart_permutation();
 }
+
 uint64_t VirtualMemory::shamt(std::size_t level) const { return LOG2_PAGE_SIZE + champsim::lg2(pte_page_size / PTE_BYTES) * (level - 1); }
 
 uint64_t VirtualMemory::get_offset(uint64_t vaddr, std::size_t level) const
@@ -205,56 +1766,203 @@ uint64_t VirtualMemory::get_offset(uint64_t vaddr, std::size_t level) const
   return (vaddr >> shamt(level)) & champsim::bitmask(champsim::lg2(pte_page_size / PTE_BYTES));
 }
 
-uint64_t VirtualMemory::ppage_front(uint64_t cycle, uint64_t vaddr) const //edited to pass in cycle and vaddr
+// std::size_t VirtualMemory::available_ppages() const { return ppage_free_list.size(); } returning number of free frames available  
+std::size_t VirtualMemory::available_ppages() const
+{
+  std::size_t frames = 0;
+  for (const auto& node : nodes)
+    frames += node.available_frames();
+  return frames;
+}
+
+std::size_t VirtualMemory::local_node(uint32_t cpu_num) const
 {
-  assert(available_ppages() > 0);
-  return ppage_free_list.front();
-  // checking if pages are availbe and returns the first free frame found
+  return cpu_num < config.cpu_nodes.size() ? config.cpu_nodes[cpu_num] : cpu_num % nodes.size();
 }
 
-void VirtualMemory::ppage_pop(uint64_t cycle, uint64_t vaddr)
-{ 
+std::size_t VirtualMemory::fallback_node(std::size_t node) const
+{
+  if (nodes[node].available_frames() > 0)
+    return node;
+  auto fullest = std::max_element(nodes.begin(), nodes.end(), [](const auto& a, const auto& b) { return a.available_frames() < b.available_frames(); });
+  return static_cast<std::size_t>(std::distance(nodes.begin(), fullest));
+}
 
-  //removes the frame from the free frame list
-  ppage_free_list.pop_front();
-  if(available_ppages() == 0)
-  {
-    populate_pages();
-    shuffle_pages();
+std::size_t VirtualMemory::placement_node(uint32_t cpu_num, uint64_t interleave_index) const
+{
+  if (nodes.size() == 1)
+    return 0;
+
+  switch (config.numa_policy) {
+  case numa_placement::interleave:
+    return fallback_node(interleave_index % nodes.size());
+  case numa_placement::bind_by_cpu:
+    if (nodes[local_node(cpu_num)].available_frames() == 0)
+      throw std::runtime_error(fmt::format("VMEM node {} bound to cpu {} has no free frames", local_node(cpu_num), cpu_num));
+    return local_node(cpu_num);
+  case numa_placement::first_touch_local:
+    break;
   }
-  // in the case we run out physcial memory we will repop the enitre free frame list
+  return fallback_node(local_node(cpu_num));
 }
 
-// std::size_t VirtualMemory::available_ppages() const { return ppage_free_list.size(); } returning number of free frames available  
-std::size_t VirtualMemory::available_ppages() const { return BA.free_frame_table.size(); }
+void VirtualMemory::count_translation(uint32_t cpu_num, uint64_t ppage)
+{
+  if (nodes.size() > 1) {
+    auto node = node_of(ppage);
+    sim_stats.translations_by_node[node]++;
+    sim_stats.remote_translations += node != local_node(cpu_num);
+  }
+}
 
-std::pair<uint64_t, uint64_t> VirtualMemory::va_to_pa(uint32_t cpu_num, uint64_t vaddr)
+void VirtualMemory::reclaim_frames(uint64_t cycle)
 {
+  for (auto& node : nodes)
+    if (node.unparked_frames() < config.reclaim_low_watermark)
+      reclaim_node(node, cycle);
+}
 
-  bool faulty;
-  uint64_t ppage;
+void VirtualMemory::reclaim_node(BuddyAllocator& node, uint64_t cycle)
+{
+  sim_stats.reclaim_batches++;
+
+  // parked frames do not count, only some cpus may take them
+  while (node.unparked_frames() < config.reclaim_low_watermark + config.reclaim_batch && !node.allocated_frame_table.empty()) {
+    auto index = node.select_victim(cycle);
+    if (index == node.allocated_frame_table.size())
+      break; // only extents in use this cycle are left
+    auto victim = node.allocated_frame_table[index];
+
+    // unmap every page of the extent, remembering them so the next touch pays for the swap-in
+    if (victim.huge) {
+      auto key = FlatPageMap::pack(victim.cpu, victim.start_page >> (shamt(HUGE_LEAF_LEVEL) - LOG2_PAGE_SIZE));
+      huge_page_map.erase(key);
+      swapped_regions.try_emplace(key, 1);
+    } else {
+      for (uint64_t page = victim.start_page; page < victim.start_page + victim.size; page++) {
+        auto key = FlatPageMap::pack(victim.cpu, page);
+        vpage_to_ppage_map.erase(key);
+        swapped_pages.try_emplace(key, 1);
+      }
+    }
+    translation_memo[victim.cpu] = {};
+    if (adjacency)
+      for (uint64_t frame = victim.start_frame; frame < victim.start_frame + victim.size; frame++)
+        adjacency->erase(frame);
+    record_event(vmem_event_type::reclaim, victim.cpu, victim.start_page << LOG2_PAGE_SIZE, uint64_t{victim.start_frame} << LOG2_PAGE_SIZE, victim.size);
 
-  // checking if there is an existing entry. If not then we are creating a new entry using vmem
-  
-  if (vpage_to_ppage_map.find({cpu_num, vaddr >> LOG2_PAGE_SIZE}) != vpage_to_ppage_map.end())
-  {
-    faulty = false;
+    sim_stats.reclaimed_frames += node.deallocation(index);
   }
+}
 
-  else{
-    faulty = true;
-    fmt::print("va-to-pa-Creating new entry \n");
+// an extent backs consecutive pages with consecutive frames, huge or not
+void VirtualMemory::index_extent_pages(const BuddyAllocator& node, std::size_t index)
+{
+  const auto& entry = node.allocated_frame_table[index];
+  for (uint64_t i = 0; i < entry.size; i++)
+    adjacency->insert(entry.start_frame + i, static_cast<uint32_t>(entry.cpu), entry.start_page + i);
+}
+
+uint64_t VirtualMemory::huge_region(uint32_t cpu_num, uint64_t vaddr, bool& allocated, bool& major)
+{
+  auto key = FlatPageMap::pack(cpu_num, vaddr >> shamt(HUGE_LEAF_LEVEL));
+  auto [region, inserted] = huge_page_map.try_emplace(key, SPLIT_REGION);
+  if (inserted) {
+    write_epoch_metrics();
+    auto order = champsim::lg2(pte_page_size / PTE_BYTES);
+    auto& node = nodes[placement_node(cpu_num, vaddr >> shamt(HUGE_LEAF_LEVEL))];
+    if (node.can_allocate_block(order)) {
+      *region = node.ppage_allocate_huge(dram.current_cycle, vaddr, order, cpu_num);
+      if (adjacency)
+        index_extent_pages(node, node.allocated_frame_table.size() - 1);
+      record_event(vmem_event_type::huge_fault, cpu_num, vaddr, *region);
+      major = config.reclaim && swapped_regions.erase(key);
+      allocated = true;
+      sim_stats.huge_faults++;
+    } else {
+      sim_stats.split_regions++;
+    }
   }
 
-  // ppage will be created or existing frame, fault 1 if it missed 0 if already defined 
-   
-  if (faulty) {// if there isn't a current page tabe entry
-  
-    vpage_to_ppage_map[{cpu_num,vaddr >> LOG2_PAGE_SIZE}] = BA.ppage_allocate(dram.current_cycle, vaddr); // allocating with buddy allocator
-    fmt::print(" vaddr: {:x} cycle: {:x} \n", vaddr, dram.current_cycle);
+  return *region;
+}
+
+std::size_t VirtualMemory::leaf_level(uint32_t cpu_num, uint64_t vaddr) const
+{
+  if (config.huge_pages) {
+    auto region = huge_page_map.find(FlatPageMap::pack(cpu_num, vaddr >> shamt(HUGE_LEAF_LEVEL)));
+    if (region != nullptr && *region != SPLIT_REGION)
+      return HUGE_LEAF_LEVEL;
+  }
+  return 1;
+}
+
+std::pair<uint64_t, uint64_t> VirtualMemory::va_to_pa(uint32_t cpu_num, uint64_t vaddr, bool write)
+{
+  if (cpu_num >= translation_memo.size())
+    add_cpu(cpu_num);
+
+  // consecutive accesses to the same page skip the table entirely, unless a write has to copy it first
+  auto& memo = translation_memo[cpu_num];
+  if (config.translation_memo) {
+    if (memo.ppage != 0 && memo.vpage == (vaddr >> LOG2_PAGE_SIZE) && !(write && is_shared(memo.ppage))) {
+      sim_stats.memo_hits++;
+      count_translation(cpu_num, memo.ppage);
+      if (config.reclaim)
+        nodes[node_of(memo.ppage)].touch(memo.ppage >> LOG2_PAGE_SIZE, dram.current_cycle);
+      return {champsim::splice_bits(memo.ppage, vaddr, LOG2_PAGE_SIZE), 0};
+    }
+    sim_stats.memo_misses++;
+  }
+
+  // reclaim before probing, evictions move entries around in the page maps
+  if (config.reclaim)
+    reclaim_frames(dram.current_cycle);
+
+  bool faulty = false;
+  bool major = false;
+  bool copied = false;
+  uint64_t ppage;
+  uint64_t region = config.huge_pages ? huge_region(cpu_num, vaddr, faulty, major) : SPLIT_REGION;
+
+  if (region != SPLIT_REGION) {
+    ppage = champsim::splice_bits(region, vaddr, shamt(HUGE_LEAF_LEVEL)) & ~champsim::bitmask(LOG2_PAGE_SIZE); // the 4KB page inside the block
+  } else {
+    // checking if there is an existing entry. If not then we are creating a new entry using vmem
+    // the probe that misses is also the one that reserves the slot
+    auto key = FlatPageMap::pack(cpu_num, vaddr >> LOG2_PAGE_SIZE);
+    auto [entry, inserted] = vpage_to_ppage_map.try_emplace(key, 0);
+    faulty = inserted;
+
+    if (faulty) {// if there isn't a current page tabe entry
+      write_epoch_metrics();
+      major = config.reclaim && swapped_pages.erase(key);
+      auto group = write ? NOT_SHARED : sharing_group(cpu_num, vaddr);
+      if (group != NOT_SHARED) {
+        *entry = map_shared(cpu_num, vaddr, group);
+      } else {
+        auto& node = nodes[placement_node(cpu_num, vaddr >> LOG2_PAGE_SIZE)];
+        *entry = node.ppage_allocate(dram.current_cycle, vaddr, cpu_num); // allocating with buddy allocator
+        record_event(node.last_allocation_merged ? vmem_event_type::merge : vmem_event_type::fault, cpu_num, vaddr, *entry);
+      }
+      if (adjacency)
+        adjacency->insert(*entry >> LOG2_PAGE_SIZE, cpu_num, vaddr >> LOG2_PAGE_SIZE);
+    } else if (write && is_shared(*entry)) {
+      auto copy = copy_on_write(cpu_num, vaddr, *entry);
+      copied = copy != *entry;
+      *entry = copy;
+    }
+
+    ppage = *entry;
   }
+  memo = {vaddr >> LOG2_PAGE_SIZE, ppage};
+  count_translation(cpu_num, ppage);
 
-  ppage = vpage_to_ppage_map[{cpu_num,vaddr >> LOG2_PAGE_SIZE}];
+  if (major) {
+    sim_stats.major_faults++;
+    record_event(vmem_event_type::major_fault, cpu_num, vaddr, ppage);
+  } else if (!faulty && config.reclaim)
+    nodes[node_of(ppage)].touch(ppage >> LOG2_PAGE_SIZE, dram.current_cycle);
 
   auto paddr = champsim::splice_bits(ppage, vaddr, LOG2_PAGE_SIZE);
 
@@ -262,53 +1970,135 @@ std::pair<uint64_t, uint64_t> VirtualMemory::va_to_pa(uint32_t cpu_num, uint64_t
     fmt::print("[VMEM] {} paddr: {:x} vaddr: {:x} fault: {}\n", __func__, paddr, vaddr, faulty);
   }
 
+  if (major)
+    return {paddr, config.major_fault_penalty};
+  if (copied)
+    return {paddr, config.cow_penalty};
   return {paddr, faulty ? minor_fault_penalty : 0};
 } 
 
+uint32_t VirtualMemory::sharing_group(uint32_t cpu_num, uint64_t vaddr) const
+{
+  for (auto [begin, end] : config.shared_ranges)
+    if (vaddr >= begin && vaddr < end)
+      return SHARED_RANGE_GROUP;
+  return cpu_num < sharing_group_of.size() ? sharing_group_of[cpu_num] : NOT_SHARED;
+}
+
+// the first cpu of the group to read the page allocates it as usual, the others only take a reference
+uint64_t VirtualMemory::map_shared(uint32_t cpu_num, uint64_t vaddr, uint32_t group)
+{
+  auto [shared, inserted] = shared_pages.try_emplace(FlatPageMap::pack(group, vaddr >> LOG2_PAGE_SIZE), 0);
+  if (inserted) {
+    auto& node = nodes[placement_node(cpu_num, vaddr >> LOG2_PAGE_SIZE)];
+    *shared = node.ppage_allocate(dram.current_cycle, vaddr, cpu_num);
+    frame_references.try_emplace(*shared >> LOG2_PAGE_SIZE, 1);
+    record_event(node.last_allocation_merged ? vmem_event_type::merge : vmem_event_type::fault, cpu_num, vaddr, *shared);
+    return *shared;
+  }
+
+  auto references = frame_references.try_emplace(*shared >> LOG2_PAGE_SIZE, 0).first;
+  ++*references;
+  sim_stats.shared_faults++;
+  record_event(vmem_event_type::shared_fault, cpu_num, vaddr, *shared, static_cast<uint32_t>(*references));
+  return *shared;
+}
+
+// the last cpu still mapping a shared frame keeps it without copying, and later readers of the page start a new one
+uint64_t VirtualMemory::copy_on_write(uint32_t cpu_num, uint64_t vaddr, uint64_t ppage)
+{
+  auto frame = ppage >> LOG2_PAGE_SIZE;
+  auto references = frame_references.try_emplace(frame, 0).first;
+  if (*references == 1) {
+    frame_references.erase(frame);
+    shared_pages.erase(FlatPageMap::pack(sharing_group(cpu_num, vaddr), vaddr >> LOG2_PAGE_SIZE));
+    return ppage;
+  }
+
+  --*references;
+  auto copy = nodes[placement_node(cpu_num, vaddr >> LOG2_PAGE_SIZE)].ppage_allocate(dram.current_cycle, vaddr, cpu_num);
+  if (adjacency) {
+    adjacency->erase(frame, cpu_num);
+    adjacency->insert(copy >> LOG2_PAGE_SIZE, cpu_num, vaddr >> LOG2_PAGE_SIZE);
+  }
+  sim_stats.cow_copies++;
+  record_event(vmem_event_type::cow_copy, cpu_num, vaddr, copy);
+  return copy;
+}
+
 
 std::pair<uint64_t, uint64_t> VirtualMemory::get_pte_pa(uint32_t cpu_num, uint64_t vaddr, std::size_t level)
 {
 
-  if (next_pte_page == 0) { // if we're waiting on an allocation then we will assume there is none and alllocate
+  if (cpu_num >= translation_memo.size())
+    add_cpu(cpu_num);
+
+  if (config.reclaim)
+    reclaim_frames(dram.current_cycle);
 
-    // next_pte_page = ppage_front(dram.current_cycle, vaddr); 
-    // ppage_pop(dram.current_cycle, vaddr);
+  auto& pte_cursor = next_pte_page[cpu_num];
+  if (pte_cursor == 0) { // if we're waiting on an allocation then we will assume there is none and alllocate
 
-    next_pte_page = BA.ppage_allocate(dram.current_cycle, vaddr); 
+    // page table pages are not part of any extent, so reclaim never takes them; they come from the node of the walking cpu
+    pte_cursor = nodes[fallback_node(local_node(cpu_num))].ppage_allocate_pinned(cpu_num);
   
   }
 
-  std::tuple key{cpu_num, vaddr >> shamt(level), level};
-  // auto [ppage, fault] = page_table.insert({key, next_pte_page});
-  
-  bool faulty;
+  // a huge page is mapped by its level 2 entry: reading that entry faults the whole block in, and from then on
+  // leaf_level() ends the walk there. A walker that reads level 1 anyway gets the level 2 entry, no PTE page is made
+  uint64_t huge_penalty = 0;
+  if (config.huge_pages && level <= HUGE_LEAF_LEVEL) {
+    bool allocated = false;
+    bool major = false;
+    if (huge_region(cpu_num, vaddr, allocated, major) != SPLIT_REGION) {
+      if (major)
+        sim_stats.major_faults++;
+      huge_penalty = major ? config.major_fault_penalty : (allocated ? minor_fault_penalty : 0);
+      level = HUGE_LEAF_LEVEL;
+    }
+  }
+
+  // upper levels are shared by huge ranges of the address space, so most queries stop at the page-structure cache
+  auto tag = vaddr >> shamt(level);
+  walk_cache_line* line = nullptr;
+  if (config.walk_cache_sets > 0)
+    line = &walk_cache[cpu_num][(level - 1) * config.walk_cache_sets + (tag & (config.walk_cache_sets - 1))];
+
+  bool faulty = false;
   uint64_t ppage;
 
-  if (page_table.find(key) != page_table.end())
-  {
-    faulty = false;
-  }
+  if (line != nullptr && line->ppage != 0 && line->tag == tag) {
+    sim_stats.walk_cache_hits[level]++;
+    ppage = line->ppage;
+  } else {
+    if (line != nullptr)
+      sim_stats.walk_cache_misses[level]++;
 
-  else{
-    faulty = true;
-    page_table[key] = next_pte_page;
-    fmt::print("get_pte_pa-Creating new entry \n");
+    // a single descent through the per-cpu tree finds (or makes room for) this level's entry
+    uint64_t& entry = page_table[cpu_num].entry(vaddr, level);
+    faulty = (entry == 0);
+
+    if (faulty) {
+      entry = pte_cursor;
+      record_event(vmem_event_type::pte_alloc, cpu_num, vaddr, pte_cursor, static_cast<uint32_t>(level));
+    }
+
+    ppage = entry;
+    if (line != nullptr)
+      *line = {tag, ppage};
   }
   
   // do similar thing to what was done in vadd_pp
   // have two variables fault and ppage (the actual physical page)
 
   if (faulty) {
-    next_pte_page += pte_page_size;
-    if (!(next_pte_page % PAGE_SIZE)) {
+    pte_cursor += pte_page_size;
+    if (!(pte_cursor % PAGE_SIZE)) {
 
-      next_pte_page = BA.ppage_allocate(dram.current_cycle, vaddr);
-      fmt::print(" PTE: {:x} cycle: {:x} \n", vaddr, dram.current_cycle);
+      pte_cursor = nodes[fallback_node(local_node(cpu_num))].ppage_allocate_pinned(cpu_num);
     }
   }
 
-  ppage = page_table[key];
-
   auto offset = get_offset(vaddr, level);
   auto paddr = champsim::splice_bits(ppage, offset * PTE_BYTES, champsim::lg2(pte_page_size)); // ppage->second
 
@@ -317,5 +2107,5 @@ std::pair<uint64_t, uint64_t> VirtualMemory::get_pte_pa(uint32_t cpu_num, uint64
     fmt::print("[VMEM] {} paddr: {:x} vaddr: {:x} pt_page_offset: {} translation_level: {} fault: {}\n", __func__, paddr, vaddr, offset, level, faulty);
   }
 
-  return {paddr, faulty ? minor_fault_penalty : 0};
+  return {paddr, (faulty ? minor_fault_penalty : 0) + huge_penalty};
 }
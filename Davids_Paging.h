@@ -17,12 +17,24 @@
 #ifndef VMEM_H
 #define VMEM_H
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
-#include <map>
 #include <deque>
+#include <iosfwd>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "champsim_constants.h"
+#include "dram_mapping.h"
+#include "vmem_events.h"
 
 class MEMORY_CONTROLLER;
 
@@ -31,83 +43,542 @@ inline constexpr auto VMEM_RESERVE_CAPACITY = std::max<uint64_t>(PAGE_SIZE, 1ull
 
 inline constexpr std::size_t PTE_BYTES = 8;
 
+// keyed bijection over [0, domain): a 4-round Feistel network on the smallest even bit width that covers the domain,
+// cycle-walking any value that lands outside it, so walking index 0, 1, 2, ... visits every frame once in random order
+class FramePermutation
+{
+  uint64_t domain = 1;
+  unsigned half_bits = 1;
+  std::array<uint64_t, 4> round_keys{};
+
+  uint64_t encrypt(uint64_t value) const;
+
+public:
+  FramePermutation() = default;
+  FramePermutation(uint64_t domain_size, uint64_t seed);
+
+  uint64_t operator()(uint64_t index) const;
+};
+
+// the DRAM banks a frame can be told apart by: the channel, rank, bankgroup and bank bits that are the same for every line
+// of the frame under the given mapping, packed into one small integer
+class FrameColoring
+{
+  dram_address_map address_map;
+  dram_geometry geometry;
+  std::vector<std::pair<unsigned, unsigned>> color_bits; // {level, bit}, levels counted channel, rank, bankgroup, bank
+  unsigned span_order = 0;                               // an aligned block of 2^span_order frames holds every color
+
+public:
+  FrameColoring() = default;
+  FrameColoring(dram_mapping mapping, const dram_geometry& geometry);
+
+  std::size_t colors() const { return std::size_t{1} << color_bits.size(); }
+  unsigned span() const { return span_order; }
+  dram_coordinates coordinates(uint64_t frame) const { return address_map(frame << LOG2_PAGE_SIZE); } // of the frame's first line
+  std::size_t operator()(uint64_t frame) const;
+  std::size_t color_of(const dram_coordinates& coordinates) const;
+
+  // rows are numbered per color, so key - 1 and key + 1 are the rows physically next to it in the same banks
+  uint64_t rows() const { return geometry.rows(); }
+  uint64_t row_key(uint64_t frame) const; // the row of the frame's first line
+  uint64_t row_key(const dram_coordinates& coordinates) const { return color_of(coordinates) * rows() + coordinates.row; }
+};
+
 class BuddyAllocator
 {
-  struct alloc_table_entry // each entry in our allocated vector will have 4 variables
+  struct alloc_table_entry // each entry in our allocated vector will have 6 variables, packed into 24 bytes
   {
-    uint64_t start_frame; //start of the frame
-    uint64_t size; // size of allocation
-    uint64_t start_page; //  where tha allocation starts on the page
+    uint64_t start_frame : 40; //start of the frame
+    uint64_t size : 24; // size of allocation
+    uint64_t start_page : 52; //  where tha allocation starts on the page
+    uint64_t cpu : 11; // which cpu's pages this extent backs
+    uint64_t huge : 1; // mapped as one huge page rather than page by page
     uint64_t last_access; /// cycle value to keep track of when it was accessed
   };
 
+  static constexpr uint64_t MAX_EXTENT_SIZE = (1ull << 24) - 1;
+
+  // each cpu indexes its own extents by the page that would extend them, so one core never grows another core's extent,
+  // and may hold a cache of free frames taken from the shared buddy lists a batch at a time
+  struct cpu_arena {
+    std::unordered_map<uint64_t, std::size_t> extent_by_next_page;
+    std::vector<uint64_t> cache; // sorted highest first, so the lowest frame is at the back
+    uint64_t color_cursor = 0;   // how far this cpu has gone around its colors
+    std::vector<uint64_t> parked_rows; // rows holding parked frames this cpu may be able to use
+  };
+  std::vector<cpu_arena> arenas;
+  std::size_t arena_batch_order = 0; // 0 leaves every frame in the shared pool
+  uint64_t cached_frames = 0;
+
+  cpu_arena& arena(uint32_t cpu);
+  void refill_arena(cpu_arena& owner);
+  void drain_arenas(); // hands every cached frame back to the shared pool
+
+  // page coloring keeps free frames in one list per color, filled from the buddy lists a color span at a time
+  bool colored = false;
+  FrameColoring coloring;
+  std::vector<std::set<uint64_t>> color_lists;
+  bool coloring_isolate = false;
+  std::size_t coloring_domains = 1;
+
+  bool refill_colors(); // false when the shared pool is empty
+  std::size_t next_color(const cpu_arena& owner, uint32_t cpu, std::size_t step) const;
+  uint64_t get_colored_frame(uint64_t pref_frame, bool try_match, uint32_t cpu);
+
+  // guard rows: every row remembers which cpu has frames in it, and a cpu may only take a frame whose row and both
+  // neighbours are free or its own; frames it may not take are parked by row until a cpu that may use them asks
+  bool guarded = false;
+  std::vector<uint16_t> row_owner; // cpu + 1, 0 while no frame of the row is allocated
+  std::vector<uint32_t> row_frames;
+  std::map<uint64_t, std::vector<uint64_t>> parked; // ordered, so the last-resort pick is the same after a checkpoint restore
+  uint64_t parked_frames = 0;
+  struct pinned_frame {
+    uint64_t frame;
+    uint64_t cpu;
+  };
+  std::vector<pinned_frame> pinned; // page table frames, whose rows stay claimed for good
+
+  bool row_allowed(uint64_t key, uint16_t owner) const;
+  void claim_row(uint64_t frame, uint32_t cpu);
+  void release_row(uint64_t frame);
+  void offer_parked(uint64_t key); // tells the cpus that may use a parked row, or frees it when nobody borders it
+  uint64_t get_guarded_frame(uint64_t pref_frame, bool try_match, uint32_t cpu);
+
+  // reservations: the first fault in an aligned region of 2^reservation_order pages takes a whole aligned block, and
+  // later faults in the region get the frame at the same offset, so the extent grows without searching for a free neighbour.
+  // A region is not reserved again while the pages of its last reservation are still mapped
+  static constexpr std::size_t MAX_RESERVATION_ORDER = 9;
+  struct reservation {
+    uint64_t key; // cpu << 52 | first page >> reservation_order
+    uint64_t block;
+    uint64_t populated_frames;
+    std::array<uint64_t, (1ull << MAX_RESERVATION_ORDER) / 64> populated; // one bit per frame already handed out
+  };
+  std::size_t reservation_order = 0;
+  std::unordered_map<uint64_t, reservation> reservations;
+  std::deque<uint64_t> reservation_fifo; // keys, oldest first; keys of finished reservations are skipped
+  std::unordered_set<uint64_t> ended_reservations; // regions whose reservation filled up or was broken, until an extent in them is reclaimed
+  uint64_t reserved_frames = 0;          // frames of live reservations not handed out yet
+
+  bool take_reserved(uint64_t page, uint32_t cpu, uint64_t& frame);
+  void break_reservation(); // frees the unused frames of the oldest reservation
+  bool refill_pool();       // takes back the cpu caches, else the oldest reservation; false when neither holds a frame
+  [[noreturn]] void out_of_memory() const;
+
+  // the frame that would extend an extent is unique across cpus, so this index stays shared
+  std::unordered_map<uint64_t, std::size_t> extent_by_next_frame;
+
+  void index_extent(std::size_t index);
+  void unindex_extent(std::size_t index);
+  void count_extent(const alloc_table_entry& entry, int64_t sign); // adds or removes an extent from the metrics
+
+  // reclamation state: extents by first frame so an access can find its extent, and the CLOCK hand over the table
+  bool track_access = false;
+  std::map<uint64_t, std::size_t> extent_by_start_frame;
+  std::size_t clock_hand = 0;
+  uint64_t clock_lap_start = 0;
+  uint64_t clock_reference = 0; // extents not touched since this cycle are victims
+
+  // free_lists[k] holds the first frame of every free block of 2^k frames; blocks are aligned to their size
+  std::vector<std::set<uint64_t>> free_lists;
+  uint64_t free_frames = 0;
+
+  // randomized allocation walks a permutation of the frame range instead of taking the lowest free block
+  uint64_t first_frame;
+  uint64_t frame_count;
+  bool randomized = false;
+  FramePermutation permutation;
+  uint64_t permutation_seed = 0;
+  uint64_t permutation_cursor = 0;
+
+  void insert_block(uint64_t frame, std::size_t order); // adds a block without looking for its buddy
+  void carve_frame(uint64_t block, std::size_t order, uint64_t frame); // splits a free block down to a single frame
+
   public: 
-  std::vector<uint64_t> free_frame_table;
   std::vector<alloc_table_entry> allocated_frame_table;
 
 
   // here we have all of our existing functions defined in the cc file
-  BuddyAllocator(uint64_t dram_size,uint64_t frame_size);
+  BuddyAllocator(uint64_t start_frame, uint64_t end_frame);
+
+  std::size_t max_order() const { return free_lists.size() - 1; }
+  uint64_t available_frames() const { return free_frames + cached_frames + parked_frames + reserved_frames; }
+  uint64_t unparked_frames() const { return free_frames + cached_frames + reserved_frames; } // what reclaim keeps above its watermark
+
+  // returns {found, first frame of the free block containing frame, order of that block}
+  std::tuple<bool, uint64_t, std::size_t> find_free_block(uint64_t frame) const;
+  bool is_free(uint64_t frame) const { return std::get<0>(find_free_block(frame)); }
+
+  uint64_t allocate_block(std::size_t order); // lowest free block of exactly 2^order frames, splitting larger ones
+  void free_block(uint64_t frame, std::size_t order); // returns a block and coalesces it with its buddies
+
+  uint64_t get_free_frame(uint64_t pref_frame, bool try_match, uint32_t cpu = 0);
+  bool last_allocation_merged = false; // did the last ppage_allocate extend an existing extent
+
+  // kept up to date on every allocate and free, so reading them never scans the tables
+  struct allocation_metrics {
+    uint64_t allocations = 0;      // ppage_allocate calls
+    uint64_t merge_candidates = 0; // ... that found an extent ending right before the page
+    uint64_t merges = 0;           // ... that also got the frame extending it
+    uint64_t huge_allocations = 0;
+    uint64_t pinned_frames = 0;    // page table pages
+    std::vector<uint64_t> extent_size_histogram = std::vector<uint64_t>(25, 0); // bucket k: extents of [2^k, 2^(k+1)) frames
+    std::vector<uint64_t> frames_by_cpu;
+    uint64_t color_fallbacks = 0;  // isolated cpus that had to take a frame outside their colors
+    uint64_t guard_rejections = 0; // free frames passed over because of a neighbouring row
+    uint64_t guard_violations = 0; // frames handed out next to another cpu's row because nothing else was left
+    uint64_t reservations = 0;     // blocks reserved for a region
+    uint64_t reserved_faults = 0;  // faults served from a reservation
+    uint64_t broken_reservations = 0;
+
+    allocation_metrics& operator+=(const allocation_metrics& other); // sums the metrics of several allocators
+  } metrics;
+
+  std::size_t free_blocks(std::size_t order) const { return free_lists[order].size(); }
+  std::size_t largest_free_order() const; // max_order() + 1 when nothing is free
+  void randomize(uint64_t seed); // hand out frames in a seeded pseudo-random order from now on
+  void restart_permutation() { permutation_cursor = 0; }
 
-  uint64_t get_free_frame(uint64_t pref_frame, bool try_match);
+  void write(std::ostream& out) const; // checkpoint support, see VirtualMemory::save_checkpoint
+  void read(std::istream& in);
 
-  std::pair<bool,uint64_t> can_merge(uint64_t page);
+  std::pair<bool,uint64_t> can_merge(uint64_t page, uint32_t cpu = 0);
 
-  uint64_t ppage_allocate(uint64_t cycle, uint64_t vaddr);
+  uint64_t ppage_allocate(uint64_t cycle, uint64_t vaddr, uint32_t cpu = 0);
+  uint64_t ppage_allocate_pinned(uint32_t cpu = 0); // a frame outside every extent (page table pages of cpu), never reclaimed
 
-  uint64_t merging(uint64_t entry_1, uint64_t cycle);
+  bool can_allocate_block(std::size_t order) const; // is there a free block of at least 2^order frames
+  uint64_t ppage_allocate_huge(uint64_t cycle, uint64_t vaddr, std::size_t order, uint32_t cpu = 0); // maps an aligned block of 2^order frames in one step
 
-  uint64_t deallocation(uint64_t index, uint64_t cycle);
+  uint64_t merging(uint64_t pref_frame, uint64_t cycle);
+
+  uint64_t deallocation(uint64_t index); // frees an extent's frames and returns how many there were
+
+  void enable_cpu_arenas(std::size_t batch_order); // gives each cpu a cache refilled 2^batch_order frames at a time
+  // spreads each cpu over all colors in turn, or with isolate gives cpu n only the colors c with c % domains == n % domains
+  void enable_coloring(const FrameColoring& frame_coloring, bool isolate, std::size_t domains);
+  std::size_t colors() const { return colored ? coloring.colors() : 1; }
+  void enable_guard_rows(const FrameColoring& frame_rows); // keeps at least one unallocated row between rows of different cpus
+  void enable_reservations(std::size_t order); // ignored while coloring, guard rows or randomization pick the frames
+  uint64_t reserved_count() const { return reserved_frames; }
+
+  // unallocated rows bordering two cpus, the frames in them, and those plus the parked frames elsewhere: every frame
+  // some cpu cannot take until a neighbour is freed
+  std::tuple<uint64_t, uint64_t, uint64_t> guard_overhead() const;
+  uint64_t parked_count() const { return parked_frames; }
+  void enable_access_tracking();
+  void touch(uint64_t frame, uint64_t cycle); // marks the extent holding frame as recently used
+  std::size_t select_victim(uint64_t cycle); // CLOCK over last_access, returns an index into allocated_frame_table, or its size when every extent was touched at cycle
 
   //std::size_t available_ppages() const;
 };
 
+// open-addressing hash map from a packed (cpu, page) key to a physical page
+// each slot is 16 bytes and collisions are resolved by linear probing, so a lookup is usually a single cache line
+class FlatPageMap
+{
+  struct slot {
+    uint64_t key;
+    uint64_t value;
+  };
+
+  static constexpr uint64_t EMPTY_KEY = std::numeric_limits<uint64_t>::max();
+
+  std::vector<slot> slots;
+  std::size_t occupied = 0;
+  unsigned index_bits = 0;
+
+  std::size_t home(uint64_t key) const { return (key * 0x9e3779b97f4a7c15ull) >> (64 - index_bits); }
+  std::size_t next(std::size_t index) const { return (index + 1) & (slots.size() - 1); }
+  void rehash(std::size_t capacity);
+
+public:
+  // the cpu lives in the top 12 bits, pages are at most 52 bits wide
+  static constexpr unsigned CPU_SHIFT = 52;
+  static uint64_t pack(uint32_t cpu, uint64_t page) { return (uint64_t{cpu} << CPU_SHIFT) | page; }
+
+  explicit FlatPageMap(std::size_t expected_size = 0) { reserve(expected_size); }
+
+  void reserve(std::size_t expected_size); // sizes the table so expected_size entries stay under the load limit
+  std::size_t size() const { return occupied; }
+  std::size_t capacity() const { return slots.size(); }
+
+  const uint64_t* find(uint64_t key) const;
+  std::pair<uint64_t*, bool> try_emplace(uint64_t key, uint64_t value); // one probe sequence for both the hit and the insert
+  bool erase(uint64_t key);
+
+  void write(std::ostream& out) const; // the raw slot array, so a restore needs no rehash
+  void read(std::istream& in);
+
+  template <typename F>
+  void for_each(F&& func) const
+  {
+    for (const auto& s : slots)
+      if (s.key != EMPTY_KEY)
+        func(s.key, s.value);
+  }
+};
+
+// the pages resident in every DRAM row, kept up to date as frames are mapped and unmapped, so finding the pages of other
+// cpus within two rows of a given one costs four hash lookups instead of a pass over every mapping
+class AdjacencyIndex
+{
+  struct resident {
+    uint64_t frame;
+    uint64_t owner; // FlatPageMap::pack(cpu, vpage)
+  };
+
+  FrameColoring rows;
+  std::unordered_map<uint64_t, std::vector<resident>> residents_by_row; // keyed by FrameColoring::row_key
+
+public:
+  static constexpr uint64_t MAX_DISTANCE = 2;
+
+  struct neighbour {
+    uint32_t cpu;
+    uint64_t vpage;
+    uint64_t frame;
+    uint64_t distance; // in rows
+  };
+
+  explicit AdjacencyIndex(const FrameColoring& frame_rows) : rows(frame_rows) {}
+
+  void insert(uint64_t frame, uint32_t cpu, uint64_t vpage);
+  void erase(uint64_t frame);
+  void erase(uint64_t frame, uint32_t cpu); // only the mapping of cpu, for frames several cpus share
+  void clear() { residents_by_row.clear(); }
+
+  // pages of cpus other than cpu in the rows up to MAX_DISTANCE away from the given row, in the same banks
+  std::vector<neighbour> cross_domain(const dram_coordinates& where, uint32_t cpu) const;
+  std::vector<neighbour> cross_domain(uint64_t frame, uint32_t cpu) const;
+
+  // one CSV line per cross-domain pair, each pair once; returns the number of pairs at each distance
+  std::array<uint64_t, MAX_DISTANCE + 1> report(std::ostream* out) const;
+};
+
+// one CPU's page table, stored as a radix tree shaped like the PTE pages the walker touches
+// a level-L node holds the entries of every vaddr that shares vaddr >> shamt(L + 1), indexed by get_offset(vaddr, L)
+class RadixPageTable
+{
+  static constexpr uint32_t NO_NODE = 0; // node 0 of each pool is never handed out
+
+  std::size_t levels;
+  unsigned index_bits;
+  std::size_t fanout;
+
+  // upper-level nodes keep the PTE page of each entry and the node below it, level 1 nodes only need the PTE page
+  std::vector<uint64_t> inner_entries;
+  std::vector<uint32_t> inner_children;
+  std::vector<uint64_t> leaf_entries;
+  std::unordered_map<uint64_t, uint32_t> roots; // top-level nodes, keyed by the vaddr bits above the table
+
+  uint32_t new_node(std::size_t level);
+  uint64_t shamt(std::size_t level) const { return LOG2_PAGE_SIZE + index_bits * (level - 1); }
+  std::size_t offset(uint64_t vaddr, std::size_t level) const { return (vaddr >> shamt(level)) & (fanout - 1); }
+
+public:
+  RadixPageTable(std::size_t page_table_levels, uint64_t pte_page_size);
+
+  void write(std::ostream& out) const;
+  void read(std::istream& in);
+
+  // the PTE page recorded for vaddr at this level, 0 if none has been assigned yet; missing nodes are created
+  uint64_t& entry(uint64_t vaddr, std::size_t level);
+};
+
+// where the frame of a new page comes from when physical memory is split into NUMA nodes
+enum class numa_placement {
+  first_touch_local, // the node of the faulting cpu, or the node with the most free frames once it is full
+  interleave,        // pages (huge regions) round-robin over the nodes by page number, with the same fallback
+  bind_by_cpu        // only the node of the faulting cpu, running out of frames there is an error
+};
+
+// optional features of VirtualMemory, the defaults match the plain buddy-allocated 4KB paging
+struct VirtualMemoryConfig {
+  uint64_t virtual_seed = 0;        // keys the frame permutation, 0 keeps the buddy order
+  bool print_stats_on_exit = false; // print_stats from the destructor, for drivers without an end-of-phase hook
+  std::size_t walk_cache_sets = 64; // direct-mapped page-structure cache entries per cpu and level, 0 disables it
+  bool translation_memo = true;     // remember the last va_to_pa translation of each cpu
+  bool huge_pages = false;          // back each level-2 region with one aligned block, falling back to 4KB pages when none is free
+  std::size_t cpu_arena_batch_order = 0; // per-cpu frame caches refilled 2^order frames at a time, 0 shares one free pool
+
+  std::string dram_mapper;       // the Ramulator mapper: RoRaCoBaBgCh, PBPI_Mapping, RASL or MINE, needed by the two options below
+  dram_geometry geometry;        // must match the Ramulator organization the mapper runs on
+  bool page_coloring = false;    // keep free frames per bank color
+  bool coloring_isolate = false; // confine cpus to disjoint colors rather than spreading each over all of them
+  std::size_t coloring_domains = 2;
+  bool guard_rows = false;       // never give two cpus frames in adjacent rows of the same bank
+  bool adjacency_index = false;  // track which pages share nearby rows, see AdjacencyIndex
+
+  std::size_t reservation_order = 0; // reserve aligned blocks of 2^order frames per aligned region of as many pages, at most 9, 0 disables
+
+  // pages that several cpus read map one frame, and the first write from a cpu gives it a copy; not with reclaim or huge pages
+  std::vector<std::vector<uint32_t>> identical_cpus;           // groups of cpus running the same binary or trace, sharing every page
+  std::vector<std::pair<uint64_t, uint64_t>> shared_ranges;    // [begin, end) virtual ranges that every cpu shares
+  uint64_t cow_penalty = 1000;                                 // cycles charged to the write that copies a shared page
+
+  // node n owns the n-th of numa_nodes equal slices of physical memory, so every physical address names its node
+  std::size_t numa_nodes = 1;
+  numa_placement numa_policy = numa_placement::first_touch_local;
+  std::vector<std::size_t> cpu_nodes; // the local node of each cpu, cpu % numa_nodes for cpus not listed
+  std::string adjacency_report; // where finish() lists every cross-domain pair, empty (the default) for counts only
+
+  bool reclaim = false;                     // evict cold extents instead of running out of frames
+  uint64_t reclaim_low_watermark = 1024;    // free frames below which a reclaim batch runs
+  uint64_t reclaim_batch = 4096;            // frames freed above the watermark by each batch
+  uint64_t major_fault_penalty = 100000;    // cycles charged when an evicted page is touched again
+
+  std::string checkpoint_restore; // checkpoint file loaded by the constructor, empty to start cold
+  std::string checkpoint_save;    // checkpoint file written by end_warmup(), empty (the default) to skip
+  std::string event_trace = "vmem_events.bin"; // binary event file, only written when built with VMEM_EVENT_TRACE
+
+  std::string metrics_file;   // JSON lines with allocator metrics, empty (the default) to skip
+  uint64_t metrics_epoch = 0; // cycles between snapshots in metrics_file, 0 writes only the final one
+};
+
 class VirtualMemory
 {
 private:
-  std::map<std::pair<uint32_t, uint64_t>, uint64_t> vpage_to_ppage_map;
-  std::map<std::tuple<uint32_t, uint64_t, uint32_t>, uint64_t> page_table;
+  // one line of the page-structure cache, the PTE page of an entry never changes once assigned
+  struct walk_cache_line {
+    uint64_t tag = 0;
+    uint64_t ppage = 0;
+  };
 
-  //for randomization
-  std::deque<uint64_t> ppage_free_list;
+  struct last_translation {
+    uint64_t vpage = 0;
+    uint64_t ppage = 0;
+  };
+
+  // huge regions that could not get a block keep this marker and are paged at 4KB
+  static constexpr uint64_t SPLIT_REGION = 1;
+  static constexpr std::size_t HUGE_LEAF_LEVEL = 2;
+
+  FlatPageMap vpage_to_ppage_map;
+  FlatPageMap huge_page_map; // (cpu, vaddr >> shamt(HUGE_LEAF_LEVEL)) to the first byte of the block, or SPLIT_REGION
+  FlatPageMap swapped_pages;   // pages and huge regions that were reclaimed, so their next fault is a major one
+  FlatPageMap swapped_regions;
+  std::vector<RadixPageTable> page_table; // one per cpu
+  std::vector<std::vector<walk_cache_line>> walk_cache; // per cpu, level-major
+  std::vector<last_translation> translation_memo; // per cpu
+
+  void add_cpu(uint32_t cpu_num); // grows the per-cpu structures
+  uint64_t huge_region(uint32_t cpu_num, uint64_t vaddr, bool& allocated, bool& major); // decides the region on its first touch
+  void reclaim_frames(uint64_t cycle); // reclaims on every node whose free frames dropped under the low watermark
+  void reclaim_node(BuddyAllocator& node, uint64_t cycle);
+
+  uint64_t frames_per_node;
+  std::size_t local_node(uint32_t cpu_num) const;
+  std::size_t placement_node(uint32_t cpu_num, uint64_t interleave_index) const; // applies config.numa_policy
+  std::size_t fallback_node(std::size_t node) const; // node itself while it has free frames
+  void count_translation(uint32_t cpu_num, uint64_t ppage);
+
+  // the allocator metrics and free space summed over every node
+  struct allocator_summary {
+    BuddyAllocator::allocation_metrics metrics;
+    uint64_t free_frames = 0;
+    std::vector<uint64_t> free_blocks; // by order
+    uint64_t largest_free_block = 0;   // in frames
+    std::size_t extents = 0;
+    uint64_t parked_frames = 0;
+    uint64_t reserved_frames = 0;
+  };
+  allocator_summary summarize_nodes() const;
 
+  std::unique_ptr<std::ostream> metrics_out;
+  uint64_t next_metrics_epoch = 0;
+  bool final_written = false; // finish() has run
+  void write_metrics(const char* phase, uint64_t cycle) const;
+  void write_epoch_metrics(); // an "epoch" record when the current cycle has reached next_metrics_epoch
+
+  std::unique_ptr<AdjacencyIndex> adjacency;
+  void index_extent_pages(const BuddyAllocator& node, std::size_t index); // adds every page of an extent to the adjacency index
+
+  // frames mapped by more than one cpu until written: the frame of each shared (group, vpage), and the mappings of each frame
+  static constexpr uint32_t NOT_SHARED = std::numeric_limits<uint32_t>::max();
+  static constexpr uint32_t SHARED_RANGE_GROUP = (1u << (64 - FlatPageMap::CPU_SHIFT)) - 1; // past every identical_cpus group
+  std::vector<uint32_t> sharing_group_of; // indexed by cpu, NOT_SHARED outside identical_cpus
+  FlatPageMap shared_pages;
+  FlatPageMap frame_references;
+  bool sharing() const { return !config.identical_cpus.empty() || !config.shared_ranges.empty(); }
+  uint32_t sharing_group(uint32_t cpu_num, uint64_t vaddr) const;
+  bool is_shared(uint64_t ppage) const { return frame_references.size() > 0 && frame_references.find(ppage >> LOG2_PAGE_SIZE) != nullptr; }
+  uint64_t map_shared(uint32_t cpu_num, uint64_t vaddr, uint32_t group); // the fault path of a page that is read before it is written
+  uint64_t copy_on_write(uint32_t cpu_num, uint64_t vaddr, uint64_t ppage);
+
+  std::unique_ptr<VmemEventRecorder> events;
+  void record_event(vmem_event_type type, uint32_t cpu_num, uint64_t vaddr, uint64_t paddr, uint32_t arg = 0)
+  {
+    if constexpr (vmem_event_trace) {
+      if (events)
+        events->record({dram_cycle(), vaddr, paddr, type, static_cast<uint16_t>(cpu_num), arg});
+    }
+  }
+  uint64_t dram_cycle() const;
 
   //two vector to keep track of our free frames and allocated frames
   std::vector<uint64_t> free_table;
   std::vector<uint64_t> allocated_table;
 
-  uint64_t next_pte_page = 0;
+  std::vector<uint64_t> next_pte_page; // per cpu, so a page table frame only holds entries of the cpu whose rows it claimed
 
   uint64_t next_ppage;
   uint64_t last_ppage;
 
-  uint64_t ppage_front(uint64_t cycle, uint64_t vaddr) const;
-  void ppage_pop(uint64_t cycle, uint64_t vaddr);
-
   MEMORY_CONTROLLER& dram;
 
 public:
 
-  BuddyAllocator BA; // constructs the buddy allocator
+  std::vector<BuddyAllocator> nodes; // one buddy allocator per NUMA node, see node_of
 
-  static uint64_t virtual_seed;
+  uint64_t virtual_seed; // starts as config.virtual_seed
   uint64_t pmem_size;
   const uint64_t minor_fault_penalty;
   const std::size_t pt_levels;
   const uint64_t pte_page_size; // Size of a PTE page
+  const VirtualMemoryConfig config;
 
+  struct stats {
+    uint64_t major_faults = 0;
+    uint64_t reclaim_batches = 0;
+    uint64_t reclaimed_frames = 0;
+    uint64_t huge_faults = 0;
+    uint64_t split_regions = 0;
+    uint64_t memo_hits = 0;
+    uint64_t memo_misses = 0;
+    uint64_t shared_faults = 0; // faults that mapped a frame another cpu had already faulted in
+    uint64_t cow_copies = 0;
+    std::vector<uint64_t> walk_cache_hits; // indexed by level
+    std::vector<uint64_t> walk_cache_misses;
+    std::vector<uint64_t> translations_by_node; // va_to_pa results by the node of the frame, only with several nodes
+    uint64_t remote_translations = 0;           // ... where that node is not the local node of the cpu
+  } sim_stats;
 
   // capacity and pg_size are measured in bytes, and capacity must be a multiple of pg_size
-  VirtualMemory(uint64_t pg_size, std::size_t page_table_levels, uint64_t minor_penalty, MEMORY_CONTROLLER& dram);
+  VirtualMemory(uint64_t pg_size, std::size_t page_table_levels, uint64_t minor_penalty, MEMORY_CONTROLLER& dram, VirtualMemoryConfig cfg = {});
+  ~VirtualMemory();
+  void print_stats() const; // the VMEM lines of the end-of-run report, called by the simulator's end-of-phase hook
+  void end_warmup(); // called by the driver when warmup ends, saves config.checkpoint_save so later runs start from the warmed layout
+  void finish(); // the final metrics record and the adjacency report, once; the destructor calls it if the driver has not
+  void write_adjacency_report() const; // the CSV named by config.adjacency_report, written by finish()
+
+  // the whole allocation state (page maps, page tables, free lists, extents) in a versioned binary file;
+  // every section is a length-prefixed array of fixed-width records padded to 8 bytes, so loading it is a few bulk reads
+  void save_checkpoint(const std::string& path) const;
+  void load_checkpoint(const std::string& path);
   uint64_t shamt(std::size_t level) const;
   uint64_t get_offset(uint64_t vaddr, std::size_t level) const;
   std::size_t available_ppages() const;
-  std::pair<uint64_t, uint64_t> va_to_pa(uint32_t cpu_num, uint64_t vaddr);
+  std::size_t node_of(uint64_t paddr) const { return std::min<std::size_t>((paddr >> LOG2_PAGE_SIZE) / frames_per_node, nodes.size() - 1); }
+  std::pair<uint64_t, uint64_t> va_to_pa(uint32_t cpu_num, uint64_t vaddr, bool write = false); // callers that know stores pass write for copy-on-write
   std::pair<uint64_t, uint64_t> get_pte_pa(uint32_t cpu_num, uint64_t vaddr, std::size_t level);
-  static void set_virtual_seed(uint64_t v_seed);
+  std::size_t leaf_level(uint32_t cpu_num, uint64_t vaddr) const; // the lowest level a walk of vaddr has to read, checked after each level
+  const AdjacencyIndex* adjacency_index() const { return adjacency.get(); } // null unless config.adjacency_index
+  void set_virtual_seed(uint64_t v_seed); // rekeys the permutation of this instance only
 
-  void shuffle_pages();
-  void populate_pages();
+  void shuffle_pages(); // keys the frame permutation with virtual_seed, 0 keeps the buddy order
+  void populate_pages(); // starts the permutation over from its first frame
 };
 
 #endif
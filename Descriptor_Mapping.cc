@@ -0,0 +1,214 @@
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <span>
+
+#include "base/base.h"
+#include "dram/dram.h"
+#include "addr_mapper/addr_mapper.h"
+#include "memory_system/memory_system.h"
+
+#include "mapping_program.h"
+
+/*
+ * A mapper whose bit order comes from the config file instead of C++. Each entry of "fields" takes the next bits of
+ * the address (after the transaction offset, lowest first) and places them into one level:
+ *
+ *   level[:bits][^xor][<<rotate | @p0,p1,...][+add]
+ *
+ *   bits     how many bits to take, by default whatever the level has not been given yet; a level may appear more
+ *            than once, later pieces land above the earlier ones
+ *   ^xor     xor the piece with the physical address bits starting at bit xor
+ *   <<rotate rotate the piece left by rotate % bits
+ *   @p...    send bit i of the piece to bit p_i of its place in the level
+ *   +add     add a constant to the finished level, modulo its size
+ *
+ * "-:bits" skips address bits. The schemes in Yanezs_RASL.cc and Raymonds.cc, for DDR4 with 64B transactions:
+ *
+ *   RoRaCoBaBgCh  [channel, bankgroup, bank, column, rank, row]
+ *   PBPI_Mapping  [channel, "column:2", "bankgroup^17", "bank^19", column, rank, row]
+ *   RASL          ["channel<<3", "bankgroup<<3", "bank<<3", "column<<3", "rank<<3", "row<<3"]
+ *   MINE          ["column:2", channel, rank, bankgroup, bank, "row+15"]
+ *
+ * setup() compiles the fields into a mapping_program, so apply() and apply_batch() are passes over a flat table of
+ * (shift, mask, xor mask, level) operations with no level name lookups. Levels no field mentions are -1.
+ */
+
+namespace Ramulator{
+  class Descriptor final : public IAddrMapper, public Implementation {
+    RAMULATOR_REGISTER_IMPLEMENTATION(IAddrMapper, Descriptor, "Descriptor", "Applies a mapping compiled from the field order in the config.");
+
+  public:
+    IDRAM* m_dram = nullptr;
+
+    int m_num_levels = -1;          // How many levels in the hierarchy?
+    std::vector<int> m_addr_bits;   // How many address bits for each level in the hierarchy?
+    Addr_t m_tx_offset = -1;
+
+    mapping_program m_program;
+    std::vector<int*> m_single; // apply()'s batch of one, pointing into the request's addr_vec
+
+    std::vector<std::string> m_fields;
+
+    void init() override {
+      m_fields = param<std::vector<std::string>>("fields").desc("The address fields, lowest bits first.").required();
+    };
+
+    void setup(IFrontEnd* frontend, IMemorySystem* memory_system) {
+      m_dram = memory_system->get_ifce<IDRAM>();
+
+      // Populate m_addr_bits vector with the number of address bits for each level in the hierachy
+      const auto& count = m_dram->m_organization.count;
+      m_num_levels = count.size();
+      m_addr_bits.resize(m_num_levels);
+      for (size_t level = 0; level < m_addr_bits.size(); level++) {
+        m_addr_bits[level] = calc_log2(count[level]);
+      }
+
+      // Last (Column) address have the granularity of the prefetch size
+      m_addr_bits[m_num_levels - 1] -= calc_log2(m_dram->m_internal_prefetch_size);
+
+      int tx_bytes = m_dram->m_internal_prefetch_size * m_dram->m_channel_width / 8;
+      m_tx_offset = calc_log2(tx_bytes);
+
+      m_program.reset(m_num_levels, m_tx_offset);
+      for (int level = 0; level < m_num_levels; level++) {
+        m_program.level_mask[level] = (1u << m_addr_bits[level]) - 1;
+      }
+      m_single.resize(m_num_levels);
+
+      std::vector<int> assigned(m_num_levels, 0); // bits of each level given by earlier fields
+      std::vector<bool> mentioned(m_num_levels, false);
+      int src = 0;
+      for (const auto& field : m_fields) {
+        int level = compile_field(field, src, assigned);
+        if (level >= 0) {
+          mentioned[level] = true;
+        }
+      }
+      for (int level = 0; level < m_num_levels; level++) {
+        if (!mentioned[level]) {
+          m_program.unmapped(level);
+        }
+      }
+      if (src + m_tx_offset > 64) {
+        throw std::runtime_error(fmt::format("Descriptor mapping uses {} address bits, more than 64", src + m_tx_offset));
+      }
+    }
+
+    void apply(Request& req) override {
+      req.addr_vec.resize(m_num_levels, -1);
+      for (int level = 0; level < m_num_levels; level++) {
+        m_single[level] = &req.addr_vec[level];
+      }
+      apply_batch({&req.addr, 1}, m_single);
+    }
+
+    // levels[l][i] is level l of addrs[i]
+    void apply_batch(std::span<const Addr_t> addrs, std::span<int* const> levels) {
+      m_program.run(addrs.data(), addrs.size(), levels.data());
+    }
+
+  private:
+    // the number at text[pos], moving pos past it
+    static int parse_number(const std::string& field, size_t& pos) {
+      size_t used = 0;
+      int value = -1;
+      try {
+        value = std::stoi(field.substr(pos), &used);
+      } catch (const std::exception&) {
+      }
+      if (used == 0 || value < 0) {
+        throw std::runtime_error(fmt::format("Descriptor field \"{}\" needs a number at position {}", field, pos));
+      }
+      pos += used;
+      return value;
+    }
+
+    // the level the field places bits into, or -1 when it only skips address bits
+    int compile_field(const std::string& field, int& src, std::vector<int>& assigned) {
+      auto name_end = field.find_first_of(":^<@+");
+      std::string name = field.substr(0, name_end);
+      size_t pos = std::min(name_end, field.size());
+
+      int bits = -1;
+      int xor_shift = -1;
+      int rotate = 0;
+      std::vector<int> positions;
+      uint64_t add = 0;
+      while (pos < field.size()) {
+        char c = field[pos];
+        if (c == ':') {
+          bits = parse_number(field, ++pos);
+        } else if (c == '^') {
+          xor_shift = parse_number(field, ++pos);
+        } else if (c == '<' && pos + 1 < field.size() && field[pos + 1] == '<') {
+          pos += 2;
+          rotate = parse_number(field, pos);
+        } else if (c == '@') {
+          do {
+            positions.push_back(parse_number(field, ++pos));
+          } while (pos < field.size() && field[pos] == ',');
+        } else if (c == '+') {
+          add = parse_number(field, ++pos);
+        } else {
+          throw std::runtime_error(fmt::format("Descriptor field \"{}\" has an unexpected '{}'", field, c));
+        }
+      }
+
+      if (name == "-") {
+        if (bits < 0) {
+          throw std::runtime_error(fmt::format("Descriptor field \"{}\" skips bits but does not say how many", field));
+        }
+        src += bits;
+        return -1;
+      }
+
+      int level = -1;
+      try {
+        level = m_dram->m_levels(name);
+      } catch (const std::out_of_range& r) {
+        throw std::runtime_error(fmt::format("Descriptor field \"{}\": organization \"{}\" not found in the spec", field, name));
+      }
+
+      if (bits < 0) {
+        bits = positions.empty() ? m_addr_bits[level] - assigned[level] : static_cast<int>(positions.size());
+      }
+      if (assigned[level] + bits > m_addr_bits[level]) {
+        throw std::runtime_error(fmt::format("Descriptor field \"{}\" gives {} more bits than {} has", field, assigned[level] + bits - m_addr_bits[level], name));
+      }
+
+      // every bit's place within the piece, checked to be a permutation
+      if (positions.empty()) {
+        for (int bit = 0; bit < bits; bit++) {
+          positions.push_back(bits > 0 ? (bit + rotate) % bits : 0);
+        }
+      }
+      std::vector<bool> taken(bits, false);
+      if (static_cast<int>(positions.size()) != bits) {
+        throw std::runtime_error(fmt::format("Descriptor field \"{}\" lists {} positions for {} bits", field, positions.size(), bits));
+      }
+      for (int p : positions) {
+        if (p >= bits || taken[p]) {
+          throw std::runtime_error(fmt::format("Descriptor field \"{}\" does not permute its {} bits", field, bits));
+        }
+        taken[p] = true;
+      }
+
+      // runs of bits that stay adjacent become one op each, so a plain field is one op and a rotation two
+      for (int start = 0; start < bits;) {
+        int length = 1;
+        while (start + length < bits && positions[start + length] == positions[start] + length) {
+          length++;
+        }
+        m_program.field(level, src + start, length, assigned[level] + positions[start], xor_shift < 0 ? -1 : xor_shift + start);
+        start += length;
+      }
+
+      m_program.level_add[level] += add;
+      assigned[level] += bits;
+      src += bits;
+      return level;
+    }
+  };
+}
@@ -1,124 +1,116 @@
+#include <array>
 #include <vector>
-#include <bitset>
-#include <fstream>
+#include <bit>
+#include <span>
+#include <string>
 
 #include "base/base.h"
 #include "dram/dram.h"
 #include "addr_mapper/addr_mapper.h"
 #include "memory_system/memory_system.h"
-class MINE final : public IAddrMapper, public Implementation {
-  RAMULATOR_REGISTER_IMPLEMENTATION(IAddrMapper, MINE, "MINE", "Applies a My method mapping to the address.");
-
-public:
-  IDRAM* m_dram = nullptr;
-  int m_num_levels = -1;
-  std::vector<int> m_addr_bits;
-  Addr_t m_tx_offset = -1;
-  int m_col_bits_idx = -1;
-  int m_row_bits_idx = -1;
-
-  static std::vector<std::string> previous;
-  static int total_differing_bits;
-  static int total_bits_compared;
-
-  void init() override { };
- 
-  void setup(IFrontEnd* frontend, IMemorySystem* memory_system) {
-    m_dram = memory_system->get_ifce<IDRAM>();
-    const auto& count = m_dram->m_organization.count;
-    m_num_levels = count.size();
-    m_addr_bits.resize(m_num_levels);
-
-    for (size_t level = 0; level < m_addr_bits.size(); level++) {
-      m_addr_bits[level] = calc_log2(count[level]);
-    }
-    m_addr_bits[m_num_levels - 1] -= calc_log2(m_dram->m_internal_prefetch_size);
 
-    int tx_bytes = m_dram->m_internal_prefetch_size * m_dram->m_channel_width / 8;
-    m_tx_offset = calc_log2(tx_bytes);
+#include "mapping_program.h"
+#include "toggle_activity.h"
+
+namespace Ramulator{
+  class MINE final : public IAddrMapper, public Implementation {
+    RAMULATOR_REGISTER_IMPLEMENTATION(IAddrMapper, MINE, "MINE", "Applies a My method mapping to the address.");
+
+  public:
+    IDRAM* m_dram = nullptr;
+    int m_num_levels = -1;
+    std::vector<int> m_addr_bits;
+    Addr_t m_tx_offset = -1;
+    int m_col_bits_idx = -1;
+    int m_row_bits_idx = -1;
+
+    // how many low bits of each level count toward power consumption, channel, rank, bankgroup, bank, row, column
+    static constexpr std::array<int, 6> bit_limits = {0, 0, 2, 2, 15, 10};
+
+    // toggle history of this mapper instance, so independent simulations in one process do not share it
+    std::array<uint32_t, bit_limits.size()> previous{};
+    std::array<uint32_t, bit_limits.size()> m_limit_mask{};
+    bool m_has_previous = false;
+    mapping_program m_program;
+    std::vector<int*> m_single; // apply()'s batch of one, pointing into the request's addr_vec
+    toggle_activity m_power;
+    std::string m_power_file;
+    uint64_t m_power_interval = 0;
+
+    void init() override {
+      m_power_file = param<std::string>("power_file").desc("Where the cumulative power consumption is appended.").default_val("power_consumption_rates_MINE.txt");
+      m_power_interval = param<uint64_t>("power_interval").desc("Requests between power consumption snapshots, 0 for only the last.").default_val(1000000);
+    };
+
+    void setup(IFrontEnd* frontend, IMemorySystem* memory_system) {
+      m_dram = memory_system->get_ifce<IDRAM>();
+      const auto& count = m_dram->m_organization.count;
+      m_num_levels = count.size();
+      m_addr_bits.resize(m_num_levels);
+
+      for (size_t level = 0; level < m_addr_bits.size(); level++) {
+        m_addr_bits[level] = calc_log2(count[level]);
+      }
+      m_addr_bits[m_num_levels - 1] -= calc_log2(m_dram->m_internal_prefetch_size);
 
-    try {
-      m_row_bits_idx = m_dram->m_levels("row");
-    } catch (const std::out_of_range& r) {
-      throw std::runtime_error(fmt::format("Organization \"row\" not found in the spec, cannot use linear mapping!"));
-    }
+      int tx_bytes = m_dram->m_internal_prefetch_size * m_dram->m_channel_width / 8;
+      m_tx_offset = calc_log2(tx_bytes);
 
-    m_col_bits_idx = m_num_levels - 1;
-  }
+      try {
+        m_row_bits_idx = m_dram->m_levels("row");
+      } catch (const std::out_of_range& r) {
+        throw std::runtime_error(fmt::format("Organization \"row\" not found in the spec, cannot use linear mapping!"));
+      }
 
-  void apply(Request& req) override {
-    req.addr_vec.resize(m_num_levels, -1);
-    Addr_t addr = req.addr >> m_tx_offset;
+      m_col_bits_idx = m_num_levels - 1;
 
-    req.addr_vec[m_col_bits_idx] = slice_lower_bits(addr, 2);
-    for (int lvl = 0; lvl < m_row_bits_idx; lvl++) {
-      req.addr_vec[lvl] = slice_lower_bits(addr, m_addr_bits[lvl]);
-    }
+      if (m_num_levels > static_cast<int>(bit_limits.size())) {
+        throw std::runtime_error(fmt::format("MINE has power consumption bit limits for {} levels, the spec has {}", bit_limits.size(), m_num_levels));
+      }
+      for (size_t i = 0; i < bit_limits.size(); i++) {
+        m_limit_mask[i] = (1u << bit_limits[i]) - 1;
+      }
 
-    req.addr_vec[m_row_bits_idx] = addr;
+      // two column bits, then every level below the row, then the row shifted by a Caesar cipher of 15. Levels
+      // between the row and the column are not mapped and stay -1
+      mapping_levels levels{m_addr_bits, static_cast<unsigned>(m_tx_offset)};
+      levels.row = m_row_bits_idx;
+      levels.column = m_col_bits_idx;
+      m_program = mapping_schemes::MINE(levels);
+      m_single.resize(m_num_levels);
 
-    // Caesar cipher shift------------------------------------------------------------------------------------------------
-    int caesar_shift_1 = 15;
-    if (m_row_bits_idx >= 0 && m_row_bits_idx < m_num_levels) {
-      int total_row_space = 1 << m_addr_bits[m_row_bits_idx];
-      req.addr_vec[m_row_bits_idx] = (req.addr_vec[m_row_bits_idx] + caesar_shift_1) % total_row_space;
+      m_power.open(m_power_file, m_power_interval, m_num_levels);
     }
 
-    // Store previous binary representation---------------------------------------------------------------------------------
-    std::vector<int> bit_limits = {0, 0, 2, 2, 15, 10};
-    std::vector<std::string> og;
-
-    for (size_t i = 0; i < req.addr_vec.size(); ++i) {
-      int value = req.addr_vec[i];
-      int bit_limit = bit_limits[i];
-      if (bit_limit == 0) {
-        og.push_back("--");
-      } else {
-        int limited_value = value & ((1 << bit_limit) - 1);
-        og.push_back(std::bitset<32>(limited_value).to_string().substr(32 - bit_limit));
+    void apply(Request& req) override {
+      req.addr_vec.resize(m_num_levels, -1);
+      for (int lvl = 0; lvl < m_num_levels; lvl++) {
+        m_single[lvl] = &req.addr_vec[lvl];
       }
+      apply_batch({&req.addr, 1}, m_single);
     }
 
-    // Compare to previous and calculate power consumption---------------------------------------------------------------------
-    if (!previous.empty() && previous.size() == og.size()) {
-      for (size_t i = 0; i < og.size(); ++i) {
-        if (previous[i] != "--" && og[i] != "--") {
-          std::bitset<32> prev_bits(previous[i]);
-          std::bitset<32> og_bits(og[i]);
-          int differing_bits = (prev_bits ^ og_bits).count();
-          total_differing_bits += differing_bits;
-          total_bits_compared += bit_limits[i];
+    // levels[l][i] is level l of addrs[i]; the power consumption counts them in order, as if applied one by one
+    void apply_batch(std::span<const Addr_t> addrs, std::span<int* const> levels) {
+      m_program.run(addrs.data(), addrs.size(), levels.data());
+
+      // Compare to previous and calculate power consumption---------------------------------------------------------------------
+      // only the low bit_limits[i] bits of each level count, levels with no limit are skipped
+      for (size_t n = 0; n < addrs.size(); n++) {
+        uint64_t differing_bits = 0;
+        uint64_t bits_compared = 0;
+        for (int i = 0; i < m_num_levels; ++i) {
+          uint32_t og = levels[i][n] & m_limit_mask[i];
+          if (m_has_previous) {
+            m_power.level(i, previous[i] ^ og, bit_limits[i]);
+            differing_bits += std::popcount(previous[i] ^ og);
+            bits_compared += bit_limits[i];
+          }
+          previous[i] = og;
         }
+        m_has_previous = true;
+        m_power.request(differing_bits, bits_compared);
       }
-     
-      //std::cout << "Start of new address: \n";
-      //std::cout << "Total cumulative differing bits across all calls: " << total_differing_bits << "\n";
-      //std::cout << "Total cumulative bits compared across all calls: " << total_bits_compared << "\n";
-     
-      double power_com = static_cast<double>(total_differing_bits) / total_bits_compared;
-      std::cout << "Total power consumption: " << power_com * 100 << "%" << "\n";
-    }
-    /*
-    std::cout << "Binary representation of previous with bit limit:" << std::endl;
-    for (const auto& binary_value : previous) {
-      std::cout << binary_value << "\n";
     }
-    */
-   
-    previous = og;
-   
-    /*
-    std::cout << "Binary representation of current with bit limit:" << std::endl;
-      for (const auto& binary_value : og) {
-        std::cout << binary_value << "\n";
-      }
-    */
-  }
-};
-
-std::vector<std::string> MINE::previous;
-int MINE::total_differing_bits = 0;
-int MINE::total_bits_compared = 0;
-
+  };
 }
-#endif
@@ -1,13 +1,30 @@
 #include <vector>
-#include <bitset>
-#include <fstream>
+#include <bit>
+#include <span>
+#include <string>
 
 #include "base/base.h"
 #include "dram/dram.h"
 #include "addr_mapper/addr_mapper.h"
 #include "memory_system/memory_system.h"
 
+#include "mapping_program.h"
+#include "toggle_activity.h"
+
 namespace Ramulator{
+  // the levels of the spec for the field lists in mapping_schemes, bank group only when the spec has one
+  inline mapping_levels spec_levels(IDRAM* dram, const std::vector<int>& addr_bits, Addr_t tx_offset) {
+    mapping_levels levels{addr_bits, static_cast<unsigned>(tx_offset)};
+    levels.channel = dram->m_levels("channel");
+    levels.rank = dram->m_levels("rank");
+    if (addr_bits.size() > 5)
+      levels.bankgroup = dram->m_levels("bankgroup");
+    levels.bank = dram->m_levels("bank");
+    levels.row = dram->m_levels("row");
+    levels.column = dram->m_levels("column");
+    return levels;
+  }
+
   class RoRaCoBaBgCh final : public IAddrMapper, public Implementation {
     RAMULATOR_REGISTER_IMPLEMENTATION(IAddrMapper, RoRaCoBaBgCh, "RoRaCoBaBgCh", "Applies a RoRaCoBaBgCh mapping to the address. (Default ChampSim)");
 
@@ -21,6 +38,9 @@ namespace Ramulator{
     int m_col_bits_idx = -1;
     int m_row_bits_idx = -1;
 
+    mapping_program m_program;
+    std::vector<int*> m_single; // apply()'s batch of one, pointing into the request's addr_vec
+
     void init() override { };
     void setup(IFrontEnd* frontend, IMemorySystem* memory_system) {
       m_dram = memory_system->get_ifce<IDRAM>();
@@ -48,36 +68,24 @@ namespace Ramulator{
 
       // Assume column is always the last level
       m_col_bits_idx = m_num_levels - 1;
-    }
 
+      // channel, bank group (when the spec has one), bank, column, rank, row from the lowest bits up
+      m_program = mapping_schemes::RoRaCoBaBgCh(spec_levels(m_dram, m_addr_bits, m_tx_offset));
+      m_single.resize(m_num_levels);
+    }
 
     void apply(Request& req) override {
       req.addr_vec.resize(m_num_levels, -1);
-      Addr_t addr = req.addr >> m_tx_offset;
-      //channel
-      req.addr_vec[m_dram->m_levels("channel")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("channel")]);
-      std::cout << "The channel : " << req.addr_vec[m_dram->m_levels("channel")] << std::endl;
-      //bank group
-      //std::cout << "The bankgroup before: " << req.addr_vec[m_dram->m_levels("bankgroup")] << std::endl;
-      if(m_dram->m_organization.count.size() > 5)
-      req.addr_vec[m_dram->m_levels("bankgroup")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("bankgroup")]);
-      std::cout << "The bankgroup: " << req.addr_vec[m_dram->m_levels("bankgroup")] << std::endl;
-
-      //bank
-      req.addr_vec[m_dram->m_levels("bank")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("bank")]);
-      std::cout << "The bank: " << req.addr_vec[m_dram->m_levels("bank")] << std::endl;
-      //column
-      req.addr_vec[m_dram->m_levels("column")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("column")]);
-      std::cout << "The column: " << req.addr_vec[m_dram->m_levels("column")] << std::endl;
-      //rank
-      req.addr_vec[m_dram->m_levels("rank")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("rank")]);
-      std::cout << "The rank: " << req.addr_vec[m_dram->m_levels("rank")] << std::endl;
-      //row
-      req.addr_vec[m_dram->m_levels("row")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("row")]);
-      std::cout << "The row: " << req.addr_vec[m_dram->m_levels("row")] << std::endl;
-      std::cout << std::endl;
+      for (int level = 0; level < m_num_levels; level++)
+        m_single[level] = &req.addr_vec[level];
+      apply_batch({&req.addr, 1}, m_single);
     }
-    
+
+    // levels[l][i] is level l of addrs[i]
+    void apply_batch(std::span<const Addr_t> addrs, std::span<int* const> levels) {
+      m_program.run(addrs.data(), addrs.size(), levels.data());
+    }
+
   };
 
   class PBPI_Mapping final : public IAddrMapper, public Implementation {
@@ -96,10 +104,18 @@ namespace Ramulator{
     // store the previous address vector
     std::vector<Addr_t> m_prev_addr_vec;
 
-    // make a vector to store power consumption rates
-    std::vector<double> power_consumption_rates;
+    mapping_program m_program;
+    std::vector<int*> m_single; // apply()'s batch of one, pointing into the request's addr_vec
 
-    void init() override { };
+    // toggles between consecutive requests, appended to m_power_file every m_power_interval requests
+    toggle_activity m_power;
+    std::string m_power_file;
+    uint64_t m_power_interval = 0;
+
+    void init() override {
+      m_power_file = param<std::string>("power_file").desc("Where the cumulative power consumption is appended.").default_val("power_consumption_rates_PBPI.txt");
+      m_power_interval = param<uint64_t>("power_interval").desc("Requests between power consumption snapshots, 0 for only the last.").default_val(1000000);
+    };
     void setup(IFrontEnd* frontend, IMemorySystem* memory_system) {
       m_dram = memory_system->get_ifce<IDRAM>();
 
@@ -128,122 +144,45 @@ namespace Ramulator{
       // Assume column is always the last level
       m_col_bits_idx = m_num_levels - 1;
 
-      //tot power
-      std::vector<Addr_t> tot_power; 
+      // the column bits below the 4KB page boundary come first, the rest after bank and bank group. Bank group and
+      // bank are xored with the physical address bits from 17 up, bank group taking the low ones
+      m_program = mapping_schemes::PBPI_Mapping(spec_levels(m_dram, m_addr_bits, m_tx_offset));
+      m_single.resize(m_num_levels);
 
       // initialize the previous address vector with the same size
       m_prev_addr_vec.assign(m_num_levels, 0);
+      m_power.open(m_power_file, m_power_interval, m_num_levels);
     }
-    
-    // initialize bit counter
-    int bit_counter = 0;
-    int num_bits_pc = 0;
 
     void apply(Request& req) override {
       req.addr_vec.resize(m_num_levels, -1);
+      for (int level = 0; level < m_num_levels; level++)
+        m_single[level] = &req.addr_vec[level];
+      apply_batch({&req.addr, 1}, m_single);
+    }
 
-      // initialize xor result to hold power consumption for each level
-      Addr_t xor_result_power = 0;
-
-      // initialize power_cons to hold the bit changes for each level
-      std::vector<Addr_t> power_vector;
-
-      //retrieve the number of bits for the level currently in
-      int num_bits = m_addr_bits.size();
-
-      Addr_t col1_bits = 12 - m_tx_offset - m_addr_bits[m_dram->m_levels("bankgroup")] - m_addr_bits[m_dram->m_levels("bank")] - m_addr_bits[m_dram->m_levels("channel")];
-      //std::cout << "The number of col1_bits [" << col1_bits << "]." << std::endl;
-      Addr_t col2_bits = m_addr_bits[m_dram->m_levels("column")] - col1_bits;
-      //std::cout << "The number of col2_bits [" << col2_bits << "]." << std::endl;
-      Addr_t addr = req.addr >> m_tx_offset;
-      //std::cout << "The address is: " << addr << std::endl;
-      Addr_t xor_bits = req.addr >> 17;
-      //std::cout << "The xor_bits being used: " << xor_bits << std::endl;
-
-      //channel
-      req.addr_vec[m_dram->m_levels("channel")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("channel")]);
-      //std::cout << "The channel address is: " << req.addr_vec[m_dram->m_levels("channel")] << std::endl;
-      //col 1
-      req.addr_vec[m_dram->m_levels("column")] = slice_lower_bits(addr, col1_bits);
-      //std::cout << "The column address is: " << req.addr_vec[m_dram->m_levels("column")] << std::endl;
-      //bank group and bank
-      if(m_dram->m_organization.count.size() > 5)
-      {
-        int bankgroup_val = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("bankgroup")]) ^ xor_bits;
-        req.addr_vec[m_dram->m_levels("bankgroup")] = slice_lower_bits(bankgroup_val, m_addr_bits[m_dram->m_levels("bankgroup")]);
-        //std::cout << "After count > 5, bankgroup size is: " << req.addr_vec[m_dram->m_levels("bankgroup")] << std::endl;
-
-        int bank_val = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("bank")]) ^ (xor_bits >> m_addr_bits[m_dram->m_levels("bankgroup")]);
-        req.addr_vec[m_dram->m_levels("bank")] = slice_lower_bits(bank_val,m_addr_bits[m_dram->m_levels("bank")]);
-        //std::cout << "After count > 5, bank size is: " << req.addr_vec[m_dram->m_levels("bank")] << std::endl;
-      }
-      else
-      {
-        int bank_val = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("bank")]) ^ xor_bits;
-        req.addr_vec[m_dram->m_levels("bank")] = slice_lower_bits(bank_val, m_addr_bits[m_dram->m_levels("bank")]);
-        //std::cout << "The bankgroup size is: " << req.addr_vec[m_dram->m_levels("bank")] << std::endl;
-      }
-      //col 2
-      req.addr_vec[m_dram->m_levels("column")] += slice_lower_bits(addr, col2_bits) << col1_bits;
-      //std::cout << "The column bits is: " << req.addr_vec[m_dram->m_levels("column")] << std::endl;
-      //rank
-      req.addr_vec[m_dram->m_levels("rank")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("rank")]);
-      //std::cout << "The rank bits is: " << req.addr_vec[m_dram->m_levels("rank")] << std::endl;
-      //row
-      req.addr_vec[m_dram->m_levels("row")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("row")]);
-      //std::cout << "The row address is: " << req.addr_vec[m_dram->m_levels("row")] << std::endl;
-      //std::cout << std::endl;
-
-      // calculate bit changes for power consumption
-      for (size_t i = 0; i < m_num_levels; ++i) {
-        // uncomment for analysis [NOT FOR LONG RUNS]
-        //std::cout << "The current address for level [" << i << "]: " << req.addr_vec[i] << std::endl;
-        //std::cout << "The prev address for level [" << i << "]: " << m_prev_addr_vec[i] << std::endl;
-        xor_result_power |= (req.addr_vec[i] ^ m_prev_addr_vec[i]);
-        //std::cout << "The xor result: " << xor_result_power << std::endl;
-      }
-      //std::cout << std::endl;
-      // store xor_result into power_vector
-      power_vector.push_back(xor_result_power);
-
-
-      // power consumption -----------------------------------------------------------------------------
-        
-      // convert to binary
-      std::bitset<64> binary_representation(xor_result_power);
-
-      // count the number of 1s in the xor result 
-      int bit_transitions = std::bitset<64>(xor_result_power).count();
-
-      //update the total bit counter for transistions and total bits
-      bit_counter += bit_transitions;
-      num_bits_pc += m_addr_bits.size();
-
-      // Cast to float for proper decimal division
-      double power_consumption_rate = (static_cast<double>(bit_counter) / static_cast<double>(num_bits_pc)) * 100;
+    // levels[l][i] is level l of addrs[i]; the power consumption counts them in order, as if applied one by one
+    void apply_batch(std::span<const Addr_t> addrs, std::span<int* const> levels) {
+      m_program.run(addrs.data(), addrs.size(), levels.data());
 
-      // uncomment this for analysis [NOT FOR LONGER RUNS]
-      //std::cout << "The power consumption rate: " << std::dec << power_consumption_rate << "%" << std::endl << std::endl;  
-      power_consumption_rates.push_back(power_consumption_rate);
+      for (size_t i = 0; i < addrs.size(); i++) {
+        // initialize xor result to hold power consumption for each level
+        Addr_t xor_result_power = 0;
 
-      m_prev_addr_vec.assign(req.addr_vec.begin(), req.addr_vec.end());
+        // calculate bit changes for power consumption
+        for (int level = 0; level < m_num_levels; level++) {
+          Addr_t changed = levels[level][i] ^ m_prev_addr_vec[level];
+          m_power.level(level, changed, m_addr_bits[level]);
+          xor_result_power |= changed;
+          m_prev_addr_vec[level] = levels[level][i];
+        }
 
-      writePowerConsumptionRatesToFile("power_consumption_rates_PBPI.txt");
+        // power consumption -----------------------------------------------------------------------------
+        // a bit position counts once per request however many levels toggled it, out of one bit per level
+        m_power.request(std::popcount(static_cast<uint64_t>(xor_result_power)), m_addr_bits.size());
+      }
     }
 
-    void writePowerConsumptionRatesToFile(const std::string& filename) const {
-        std::ofstream outFile(filename);  // Open the file for writing
-
-        if (outFile.is_open()) {
-            for (size_t i = 0; i < power_consumption_rates.size(); ++i) {
-                outFile << "Cumulative Power Consumption: " << power_consumption_rates[i] << "%" << std::endl;
-            }
-            outFile.close();  // Close the file
-        } else {
-            std::cerr << "Unable to open file " << filename << std::endl;
-        }
-    }
-    
   };
   /****************************************This is where I will apply my method RASL - Yanez Saucedo*******************************************/
   class RASL final : public IAddrMapper, public Implementation {
@@ -264,10 +203,18 @@ namespace Ramulator{
     // store the previous address vector
     std::vector<Addr_t> m_prev_addr_vec;
 
-    // make a vector to store power consumption rates
-    std::vector<double> power_consumption_rates;
+    mapping_program m_program;
+    std::vector<int*> m_single; // apply()'s batch of one, pointing into the request's addr_vec
 
-    void init() override { };
+    // toggles between consecutive requests, appended to m_power_file every m_power_interval requests
+    toggle_activity m_power;
+    std::string m_power_file;
+    uint64_t m_power_interval = 0;
+
+    void init() override {
+      m_power_file = param<std::string>("power_file").desc("Where the cumulative power consumption is appended.").default_val("power_consumption_rates_rasl.txt");
+      m_power_interval = param<uint64_t>("power_interval").desc("Requests between power consumption snapshots, 0 for only the last.").default_val(1000000);
+    };
     void setup(IFrontEnd* frontend, IMemorySystem* memory_system) {
       m_dram = memory_system->get_ifce<IDRAM>();
 
@@ -300,139 +247,42 @@ namespace Ramulator{
       // Assume column is always the last level
       m_col_bits_idx = m_num_levels - 1;
 
-      //tot power
-      std::vector<Addr_t> tot_power; 
+      // channel, bank group (when the spec has one), bank, column, rank, row from the lowest bits up. RASL moves bit b
+      // of every level to (b + 3) % num_bits, which is a rotation left by 3 % num_bits: the low num_bits - rotate bits
+      // move up by rotate, the top rotate bits wrap around to the bottom
+      m_program = mapping_schemes::RASL(spec_levels(m_dram, m_addr_bits, m_tx_offset));
+      m_single.resize(m_num_levels);
 
       // initialize the previous address vector with the same size
       m_prev_addr_vec.assign(m_num_levels, 0);
+      m_power.open(m_power_file, m_power_interval, m_num_levels);
     }
-
-    // initialize bit counter
-    int bit_counter = 0;
-    int num_bits_pc = 0;
     
     void apply(Request& req) override {
       // initialize addr_vec and resize to match the number of levels in the DRAM hierarchy
       req.addr_vec.resize(m_num_levels, -1);
-
-      //shift the original address to the right by offset bits.
-      Addr_t addr = req.addr >> m_tx_offset;
-
-      //channel
-      req.addr_vec[m_dram->m_levels("channel")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("channel")]);
-  
-      //bank group
-      if(m_dram->m_organization.count.size() > 5)
-      req.addr_vec[m_dram->m_levels("bankgroup")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("bankgroup")]);
-
-      //bank
-      req.addr_vec[m_dram->m_levels("bank")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("bank")]);
-
-      //column
-      req.addr_vec[m_dram->m_levels("column")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("column")]);
-
-      //rank
-      req.addr_vec[m_dram->m_levels("rank")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("rank")]);
-
-      //row
-      req.addr_vec[m_dram->m_levels("row")] = slice_lower_bits(addr, m_addr_bits[m_dram->m_levels("row")]);
-
-      //std::cout << std::endl;
-
-      // initialize xor result to hold power consumption for each level
-      Addr_t xor_result_power = 0;
-
-      // initialize power_cons to hold the bit changes for each level
-      std::vector<Addr_t> power_vector;
-
-      // Generate random address bits for each level (iterate each level)
-      for(size_t level = 0; level < m_num_levels; level++){
-
-        //retrieve the number of bits for the level currently in
-        int num_bits = m_addr_bits[level];
-      
-        //initialize rasl_addr to hold the randomized address bits for current level
-        Addr_t rasl_addr = 0;
-
-        // loop each bit of the address level currently in to extract
-        for(int bit = 0;bit < num_bits; bit++){
-          //extract the bit at 'bit position, then shift addr right by that 'bit'
-          // bitwise 1 is to isolate the single bit at that position
-          Addr_t extracted_bit = (req.addr_vec[level] >> bit) & 1;
-          //place the extracted bit in a new, shuffled position
-          //add 3 bits to the current bit position and check if new position is within available bits for current level
-          int new_position = (bit + 3) % num_bits;
-          //place the extracted bit in rasl_addr. Shift the extracted bit left by new_position and bitwise OR with
-          //rasl_addr to combine with previous bits
-          rasl_addr |= (extracted_bit << new_position);
-        }
-        // power consumption result for each level
-        // uncomment this for analysis [NOT FOR LONGER RUNS]
-        //std::cout << "This is the previous address for level [" << level << "] : " << m_prev_addr_vec[level] << std::endl;
-        //std::cout << "This is the current address for level [" << level << "] : " << rasl_addr << std::endl;
-        xor_result_power = m_prev_addr_vec[level] ^ rasl_addr;
-        //std::cout << "This is the xor result of level [" << level << "] : " << xor_result_power << std::endl;
-        //std::cout << std::endl;
-
-        // store xor_result into power_vector
-        power_vector.push_back(xor_result_power);
-    
-        //store the result of RASL to the corresponding level
-        req.addr_vec[level] = rasl_addr;
-
-        //prepare 'addr' for the next level by shifting out the bits we've just proccessed
-        addr >> num_bits;
-
-        // update m_prev_addr_vec with current RASL for next comparison
-        m_prev_addr_vec[level] = req.addr_vec[level];
-
-        // power consumption -----------------------------------------------------------------------------
-        int bit_one_counter = 0;
-        
-        // convert to binary
-        std::bitset<64> binary_representation(xor_result_power);
-
-        // check if binary representation is correct
-        std::string binary_str = binary_representation.to_string().substr(64-num_bits);
-
-        // count the total number of 1 bits
-        for (char bit : binary_str){
-          if (bit == '1'){
-            bit_one_counter += 1;
-          }
-        }
-
-        bit_counter = bit_one_counter + bit_counter;
-        num_bits_pc = num_bits + num_bits_pc;
-
-      }
-      // Cast to float for proper decimal division
-      double power_consumption_rate = (static_cast<double>(bit_counter) / static_cast<double>(num_bits_pc)) * 100;
-
-      // uncomment this for analysis [NOT FOR LONGER RUNS]
-      //std::cout << "The power consumption rate: " << std::dec << power_consumption_rate << "%" << std::endl << std::endl;  
-      power_consumption_rates.push_back(power_consumption_rate);
-
-      // using this when not using the text file
-      for (size_t p = 0; p < power_consumption_rates.size(); ++p)
-      {
-        std::cout << "power consumption = " << power_consumption_rates[p] << "%" << std::endl;
-      }
-
-      writePowerConsumptionRatesToFile("power_consumption_rates_rasl.txt");
+      for (int level = 0; level < m_num_levels; level++)
+        m_single[level] = &req.addr_vec[level];
+      apply_batch({&req.addr, 1}, m_single);
     }
 
-    void writePowerConsumptionRatesToFile(const std::string& filename) const {
-        std::ofstream outFile(filename);  // Open the file for writing
-
-        if (outFile.is_open()) {
-            for (size_t i = 0; i < power_consumption_rates.size(); ++i) {
-                outFile << "Cumulative Power Consumption: " << power_consumption_rates[i] << "%" << std::endl;
-            }
-            outFile.close();  // Close the file
-        } else {
-            std::cerr << "Unable to open file " << filename << std::endl;
+    // levels[l][i] is level l of addrs[i]; the power consumption counts them in order, as if applied one by one
+    void apply_batch(std::span<const Addr_t> addrs, std::span<int* const> levels) {
+      m_program.run(addrs.data(), addrs.size(), levels.data());
+
+      for (size_t i = 0; i < addrs.size(); i++) {
+        uint64_t toggled = 0;
+        uint64_t compared = 0;
+        for (int level = 0; level < m_num_levels; level++) {
+          // power consumption: the bits of this level that toggled since the previous request
+          Addr_t changed = m_prev_addr_vec[level] ^ levels[level][i];
+          m_power.level(level, changed, m_addr_bits[level]);
+          toggled += std::popcount(static_cast<uint64_t>(changed));
+          compared += m_addr_bits[level];
+          m_prev_addr_vec[level] = levels[level][i];
         }
+        m_power.request(toggled, compared);
+      }
     }
   };
 }
@@ -0,0 +1,23 @@
+/*
+ * Stand-in for ChampSim's MEMORY_CONTROLLER used by the benchmarks in this directory.
+ * VirtualMemory only needs the DRAM size and the current cycle, so the benchmarks
+ * put this directory ahead of ChampSim's inc/ and link Davids_Paging.cc directly.
+ */
+
+#ifndef DRAM_CONTROLLER_H
+#define DRAM_CONTROLLER_H
+
+#include <cstdint>
+
+class MEMORY_CONTROLLER
+{
+  uint64_t dram_size;
+
+public:
+  uint64_t current_cycle = 0;
+
+  explicit MEMORY_CONTROLLER(uint64_t size) : dram_size(size) {}
+  uint64_t size() const { return dram_size; }
+};
+
+#endif
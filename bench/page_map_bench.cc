@@ -0,0 +1,98 @@
+/*
+ * Compares the FlatPageMap used by VirtualMemory::va_to_pa against the std::map it replaced.
+ *
+ * Build from the repository root with the include directories and vmem.h link described in vmem_bench.cc:
+ *   g++ -std=c++17 -O2 -Ibench -Ibench/vmem_inc -I. -I<champsim>/.csconfig -I<champsim>/inc bench/page_map_bench.cc Davids_Paging.cc \
+ *       -lfmt -o page_map_bench
+ */
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "vmem.h"
+
+namespace
+{
+struct workload {
+  const char* name;
+  std::vector<std::pair<uint32_t, uint64_t>> accesses;
+};
+
+// every (cpu, vpage) is touched once to fault it in, then the access stream replays over the working set
+workload make_workload(const char* name, std::size_t pages, std::size_t accesses, bool random)
+{
+  workload w{name, {}};
+  std::mt19937_64 rng{pages};
+  w.accesses.reserve(accesses);
+  for (std::size_t i = 0; i < accesses; i++) {
+    uint64_t page = random ? rng() % pages : i % pages;
+    w.accesses.emplace_back(static_cast<uint32_t>(page % 4), 0x7f0000000ull + page);
+  }
+  return w;
+}
+
+template <typename F>
+double time_ns(F&& func)
+{
+  auto start = std::chrono::steady_clock::now();
+  func();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// mirrors the old va_to_pa: find, operator[] on a miss, operator[] to read back
+uint64_t run_tree(const workload& w, std::size_t& nodes)
+{
+  std::map<std::pair<uint32_t, uint64_t>, uint64_t> map;
+  uint64_t next_frame = 256, checksum = 0;
+  for (auto [cpu, page] : w.accesses) {
+    if (map.find({cpu, page}) == map.end())
+      map[{cpu, page}] = next_frame++ << LOG2_PAGE_SIZE;
+    checksum += map[{cpu, page}];
+  }
+  nodes = map.size();
+  return checksum;
+}
+
+uint64_t run_flat(const workload& w, FlatPageMap& map)
+{
+  uint64_t next_frame = 256, checksum = 0;
+  for (auto [cpu, page] : w.accesses) {
+    auto [entry, inserted] = map.try_emplace(FlatPageMap::pack(cpu, page), 0);
+    if (inserted)
+      *entry = next_frame++ << LOG2_PAGE_SIZE;
+    checksum += *entry;
+  }
+  return checksum;
+}
+} // namespace
+
+int main()
+{
+  constexpr std::size_t accesses = 20'000'000;
+  // a std::map node holds the key, the value, three pointers and a color
+  constexpr std::size_t tree_node_bytes = sizeof(std::pair<const std::pair<uint32_t, uint64_t>, uint64_t>) + 4 * sizeof(void*);
+
+  std::vector<workload> workloads;
+  workloads.push_back(make_workload("sequential", 1 << 20, accesses, false));
+  workloads.push_back(make_workload("random-64K", 1 << 16, accesses, true));
+  workloads.push_back(make_workload("random-4M", 1 << 22, accesses, true));
+
+  fmt::print("{:<12} {:>10} {:>12} {:>12} {:>14} {:>14}\n", "workload", "mappings", "map ns/op", "flat ns/op", "map B/entry", "flat B/entry");
+  for (const auto& w : workloads) {
+    std::size_t nodes = 0;
+    uint64_t tree_sum = 0, flat_sum = 0;
+    FlatPageMap flat;
+
+    auto tree_ns = time_ns([&] { tree_sum = run_tree(w, nodes); });
+    auto flat_ns = time_ns([&] { flat_sum = run_flat(w, flat); });
+    if (tree_sum != flat_sum)
+      fmt::print("checksum mismatch on {}\n", w.name);
+
+    fmt::print("{:<12} {:>10} {:>12.1f} {:>12.1f} {:>14} {:>14.1f}\n", w.name, nodes, tree_ns / w.accesses.size(), flat_ns / w.accesses.size(),
+               tree_node_bytes, 16.0 * flat.capacity() / flat.size());
+  }
+}
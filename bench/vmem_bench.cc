@@ -0,0 +1,224 @@
+/*
+ * Measures VirtualMemory translation and BuddyAllocator allocation cost outside of a full ChampSim run.
+ *
+ * Build from the repository root. Davids_Paging.cc includes itself as vmem.h, which has to win over ChampSim's own
+ * inc/vmem.h, and it needs the champsim_constants.h that ChampSim's config.sh generates under .csconfig/:
+ *   mkdir -p bench/vmem_inc && ln -sf ../../Davids_Paging.h bench/vmem_inc/vmem.h
+ *   g++ -std=c++17 -O2 -Ibench -Ibench/vmem_inc -I. -I<champsim>/.csconfig -I<champsim>/inc bench/vmem_bench.cc Davids_Paging.cc \
+ *       -lfmt -pthread -o vmem_bench
+ *
+ *   ./vmem_bench                                    # every synthetic pattern
+ *   ./vmem_bench random multi-cpu                   # only the named patterns
+ *   ./vmem_bench --replay vmem_events.bin replay    # the faults recorded in an event trace
+ *
+ * Options: --accesses N, --pages N (working set per cpu), --dram-gb N, --sample N (time one access in N).
+ * Every access does what the page table walker does on a TLB miss: get_pte_pa for each level down to the leaf, then va_to_pa.
+ * Peak RSS is the process high-water mark, so run one pattern per process to compare footprints.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <sys/resource.h>
+
+#include "dram_controller.h"
+#include "vmem.h"
+#include "vmem_trace.h"
+
+namespace
+{
+using access = vmem_access;
+
+struct options {
+  std::size_t accesses = 10'000'000;
+  std::size_t pages = 1 << 16;
+  uint64_t dram_gb = 16;
+  std::size_t sample = 16;
+  std::string replay;
+};
+
+constexpr uint64_t heap_base = 0x7f0000000000ull;
+
+std::vector<access> sequential(const options& opt)
+{
+  std::vector<access> result;
+  for (std::size_t i = 0; i < opt.accesses; i++)
+    result.push_back({0, heap_base + (i % opt.pages) * PAGE_SIZE});
+  return result;
+}
+
+// every page sits in its own 2MB region, so the lower page table levels get no reuse
+std::vector<access> strided(const options& opt)
+{
+  std::vector<access> result;
+  for (std::size_t i = 0; i < opt.accesses; i++)
+    result.push_back({0, heap_base + (i % opt.pages) * (PAGE_SIZE << 9)});
+  return result;
+}
+
+std::vector<access> random(const options& opt)
+{
+  std::vector<access> result;
+  std::mt19937_64 rng{opt.pages};
+  for (std::size_t i = 0; i < opt.accesses; i++)
+    result.push_back({0, heap_base + (rng() % opt.pages) * PAGE_SIZE + (rng() % PAGE_SIZE)});
+  return result;
+}
+
+// four cpus take turns, each walking its own copy of the same virtual range
+std::vector<access> multi_cpu(const options& opt)
+{
+  std::vector<access> result;
+  std::mt19937_64 rng{opt.pages};
+  for (std::size_t i = 0; i < opt.accesses; i++)
+    result.push_back({static_cast<uint32_t>(i % 4), heap_base + (rng() % opt.pages) * PAGE_SIZE});
+  return result;
+}
+
+// the first touch of every page recorded in an event trace, in the order the simulation faulted them
+std::vector<access> replay(const options& opt) { return load_vmem_trace(opt.replay); }
+
+struct result {
+  std::size_t translations = 0;
+  std::size_t faults = 0;
+  double seconds = 0;
+  std::vector<uint64_t> latency_ns; // one in opt.sample accesses
+};
+
+result run(const std::vector<access>& accesses, const options& opt)
+{
+  MEMORY_CONTROLLER dram{opt.dram_gb << 30};
+  VirtualMemoryConfig cfg;
+  cfg.metrics_file = "";
+  cfg.event_trace = "";
+  VirtualMemory vmem{PAGE_SIZE, 5, 200, dram, cfg};
+
+  result res;
+  res.latency_ns.reserve(accesses.size() / opt.sample + 1);
+  uint64_t checksum = 0;
+
+  auto translate = [&](const access& a) {
+    for (std::size_t level = vmem.pt_levels; level >= vmem.leaf_level(a.cpu, a.vaddr); level--)
+      checksum += vmem.get_pte_pa(a.cpu, a.vaddr, level).first;
+    auto [paddr, penalty] = vmem.va_to_pa(a.cpu, a.vaddr);
+    checksum += paddr;
+    res.faults += penalty > 0;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < accesses.size(); i++) {
+    dram.current_cycle = i;
+    if (i % opt.sample == 0) {
+      auto before = std::chrono::steady_clock::now();
+      translate(accesses[i]);
+      res.latency_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - before).count());
+    } else {
+      translate(accesses[i]);
+    }
+  }
+  res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  res.translations = accesses.size();
+
+  if (checksum == 0)
+    fmt::print(stderr, "empty checksum\n"); // keeps the translations from being optimized away
+  return res;
+}
+
+// ppage_allocate on its own, with sequential pages from one cpu so every call has a merge candidate
+double allocate_ns(const options& opt)
+{
+  uint64_t frames = (opt.dram_gb << 30) >> LOG2_PAGE_SIZE;
+  BuddyAllocator allocator{0, frames};
+  auto count = std::min<uint64_t>(opt.accesses, frames / 2);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < count; i++)
+    allocator.ppage_allocate(i, heap_base + i * PAGE_SIZE);
+  auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  return elapsed / count;
+}
+
+uint64_t peak_rss_kb()
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<uint64_t>(usage.ru_maxrss);
+}
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()))];
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  options opt;
+  std::vector<std::string> patterns;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--accesses" && has_value)
+      opt.accesses = std::stoull(argv[++i]);
+    else if (arg == "--pages" && has_value)
+      opt.pages = std::stoull(argv[++i]);
+    else if (arg == "--dram-gb" && has_value)
+      opt.dram_gb = std::stoull(argv[++i]);
+    else if (arg == "--sample" && has_value)
+      opt.sample = std::max<std::size_t>(1, std::stoull(argv[++i]));
+    else if (arg == "--replay" && has_value)
+      opt.replay = argv[++i];
+    else if (arg.rfind("--", 0) == 0) {
+      fmt::print(stderr, "usage: {} [--accesses N] [--pages N] [--dram-gb N] [--sample N] [--replay trace] [pattern...]\n", argv[0]);
+      return 1;
+    } else
+      patterns.push_back(arg);
+  }
+  if (patterns.empty()) {
+    patterns = {"sequential", "strided", "random", "multi-cpu", "allocate"};
+    if (!opt.replay.empty())
+      patterns.push_back("replay");
+  }
+
+  fmt::print("{:<12} {:>11} {:>9} {:>14} {:>12} {:>8} {:>8} {:>8} {:>8} {:>8} {:>11}\n", "pattern", "accesses", "faults", "translations/s",
+             "faults/s", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "max ns", "peak RSS MB");
+  for (const auto& name : patterns) {
+    if (name == "allocate") {
+      fmt::print("{:<12} {:>11.1f} ns per ppage_allocate\n", name, allocate_ns(opt));
+      continue;
+    }
+
+    std::vector<access> accesses;
+    if (name == "sequential")
+      accesses = sequential(opt);
+    else if (name == "strided")
+      accesses = strided(opt);
+    else if (name == "random")
+      accesses = random(opt);
+    else if (name == "multi-cpu")
+      accesses = multi_cpu(opt);
+    else if (name == "replay")
+      accesses = replay(opt);
+    else {
+      fmt::print(stderr, "unknown pattern {}\n", name);
+      return 1;
+    }
+    if (accesses.empty())
+      continue;
+
+    auto res = run(accesses, opt);
+    std::sort(res.latency_ns.begin(), res.latency_ns.end());
+    fmt::print("{:<12} {:>11} {:>9} {:>14.0f} {:>12.0f} {:>8} {:>8} {:>8} {:>8} {:>8} {:>11.1f}\n", name, res.translations, res.faults,
+               res.translations / res.seconds, res.faults / res.seconds, percentile(res.latency_ns, 0.5), percentile(res.latency_ns, 0.9),
+               percentile(res.latency_ns, 0.99), percentile(res.latency_ns, 0.999), res.latency_ns.empty() ? 0 : res.latency_ns.back(),
+               peak_rss_kb() / 1024.0);
+  }
+}
@@ -0,0 +1,195 @@
+/*
+ * Runs one VirtualMemory simulation per (seed, mapper) pair on a pool of threads, all of them over the same access
+ * stream, which is decoded or generated once and only read afterwards.
+ *
+ * Build from the repository root with the include directories and vmem.h link described in vmem_bench.cc:
+ *   g++ -std=c++17 -O2 -Ibench -Ibench/vmem_inc -I. -I<champsim>/.csconfig -I<champsim>/inc bench/vmem_sweep.cc Davids_Paging.cc \
+ *       -lfmt -pthread -o vmem_sweep
+ *
+ *   ./vmem_sweep --seeds 1,2,3,4 --mappers RoRaCoBaBgCh,RASL       # 8 simulations over a synthetic stream
+ *   ./vmem_sweep --replay vmem_events.bin --seeds 0,7 --threads 2  # the faults recorded in an event trace
+ *
+ * Options: --accesses N, --pages N (working set per cpu), --cpus N, --dram-gb N for the synthetic stream and the
+ * memory size; --threads N defaults to the hardware concurrency. With --mappers every simulation keeps an adjacency
+ * index and reports the cross-domain row pairs at the end; without it only the allocation results are reported.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "dram_controller.h"
+#include "vmem.h"
+#include "vmem_trace.h"
+
+namespace
+{
+struct options {
+  std::size_t accesses = 1'000'000;
+  std::size_t pages = 1 << 16;
+  uint32_t cpus = 4;
+  uint64_t dram_gb = 16;
+  std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string replay;
+  std::vector<uint64_t> seeds{0};
+  std::vector<std::string> mappers;
+};
+
+struct job {
+  uint64_t seed;
+  std::string mapper; // empty for no adjacency index
+};
+
+struct outcome {
+  std::size_t faults = 0;
+  std::size_t extents = 0;
+  uint64_t merges = 0;
+  uint64_t free_frames = 0;
+  std::array<uint64_t, AdjacencyIndex::MAX_DISTANCE + 1> pairs{};
+  double seconds = 0;
+  std::string error;
+};
+
+constexpr uint64_t heap_base = 0x7f0000000000ull;
+
+// the cpus take turns, each touching random pages of its own copy of the same virtual range
+std::vector<vmem_access> synthetic(const options& opt)
+{
+  std::vector<vmem_access> result;
+  result.reserve(opt.accesses);
+  std::mt19937_64 rng{opt.pages};
+  for (std::size_t i = 0; i < opt.accesses; i++)
+    result.push_back({static_cast<uint32_t>(i % opt.cpus), heap_base + (rng() % opt.pages) * PAGE_SIZE});
+  return result;
+}
+
+// every simulation has its own memory controller and VirtualMemory, only the access stream is shared
+outcome run(const job& j, const std::vector<vmem_access>& accesses, const options& opt)
+{
+  outcome out;
+  try {
+    MEMORY_CONTROLLER dram{opt.dram_gb << 30};
+    VirtualMemoryConfig cfg;
+    cfg.virtual_seed = j.seed;
+    cfg.metrics_file = "";
+    cfg.event_trace = "";
+    cfg.print_stats_on_exit = false;
+    if (!j.mapper.empty()) {
+      cfg.dram_mapper = j.mapper;
+      cfg.adjacency_index = true;
+      cfg.adjacency_report = "";
+    }
+    VirtualMemory vmem{PAGE_SIZE, 5, 200, dram, cfg};
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < accesses.size(); i++) {
+      const auto& a = accesses[i];
+      dram.current_cycle = i;
+      for (std::size_t level = vmem.pt_levels; level >= vmem.leaf_level(a.cpu, a.vaddr); level--)
+        vmem.get_pte_pa(a.cpu, a.vaddr, level);
+      out.faults += vmem.va_to_pa(a.cpu, a.vaddr).second > 0;
+    }
+    out.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const auto& node : vmem.nodes) {
+      out.extents += node.allocated_frame_table.size();
+      out.merges += node.metrics.merges;
+    }
+    out.free_frames = vmem.available_ppages();
+    if (vmem.adjacency_index() != nullptr)
+      out.pairs = vmem.adjacency_index()->report(nullptr);
+  } catch (const std::exception& e) {
+    out.error = e.what();
+  }
+  return out;
+}
+
+template <typename T, typename F>
+std::vector<T> parse_list(const std::string& text, F&& parse)
+{
+  std::vector<T> result;
+  std::stringstream stream{text};
+  for (std::string item; std::getline(stream, item, ',');)
+    if (!item.empty())
+      result.push_back(parse(item));
+  return result;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  options opt;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--accesses" && has_value)
+      opt.accesses = std::stoull(argv[++i]);
+    else if (arg == "--pages" && has_value)
+      opt.pages = std::stoull(argv[++i]);
+    else if (arg == "--cpus" && has_value)
+      opt.cpus = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+    else if (arg == "--dram-gb" && has_value)
+      opt.dram_gb = std::stoull(argv[++i]);
+    else if (arg == "--threads" && has_value)
+      opt.threads = std::max<std::size_t>(1, std::stoull(argv[++i]));
+    else if (arg == "--replay" && has_value)
+      opt.replay = argv[++i];
+    else if (arg == "--seeds" && has_value)
+      opt.seeds = parse_list<uint64_t>(argv[++i], [](const std::string& s) { return std::stoull(s); });
+    else if (arg == "--mappers" && has_value)
+      opt.mappers = parse_list<std::string>(argv[++i], [](const std::string& s) { return s; });
+    else {
+      fmt::print(stderr, "usage: {} [--accesses N] [--pages N] [--cpus N] [--dram-gb N] [--threads N] [--replay trace] [--seeds a,b,...] [--mappers m,...]\n",
+                 argv[0]);
+      return 1;
+    }
+  }
+
+  const auto accesses = opt.replay.empty() ? synthetic(opt) : load_vmem_trace(opt.replay);
+  if (accesses.empty())
+    return 1;
+
+  std::vector<job> jobs;
+  for (auto seed : opt.seeds) {
+    if (opt.mappers.empty())
+      jobs.push_back({seed, ""});
+    for (const auto& mapper : opt.mappers)
+      jobs.push_back({seed, mapper});
+  }
+
+  // each worker takes the next job until none are left, results land in job order
+  std::vector<outcome> outcomes(jobs.size());
+  std::atomic<std::size_t> next_job{0};
+  std::vector<std::thread> pool;
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t t = 0; t < std::min(opt.threads, jobs.size()); t++) {
+    pool.emplace_back([&] {
+      for (auto index = next_job.fetch_add(1); index < jobs.size(); index = next_job.fetch_add(1))
+        outcomes[index] = run(jobs[index], accesses, opt);
+    });
+  }
+  for (auto& worker : pool)
+    worker.join();
+  auto wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  fmt::print("{:>20} {:<14} {:>9} {:>9} {:>9} {:>11} {:>11} {:>11} {:>9}\n", "seed", "mapper", "faults", "extents", "merges", "free frames",
+             "pairs d=1", "pairs d=2", "seconds");
+  for (std::size_t i = 0; i < jobs.size(); i++) {
+    const auto& o = outcomes[i];
+    if (!o.error.empty()) {
+      fmt::print("{:>20} {:<14} {}\n", jobs[i].seed, jobs[i].mapper.empty() ? "-" : jobs[i].mapper, o.error);
+      continue;
+    }
+    fmt::print("{:>20} {:<14} {:>9} {:>9} {:>9} {:>11} {:>11} {:>11} {:>9.2f}\n", jobs[i].seed, jobs[i].mapper.empty() ? "-" : jobs[i].mapper, o.faults,
+               o.extents, o.merges, o.free_frames, o.pairs[1], o.pairs[2], o.seconds);
+  }
+  fmt::print("{} simulations of {} accesses on {} threads in {:.2f} s\n", jobs.size(), accesses.size(), pool.size(), wall);
+}
@@ -0,0 +1,53 @@
+/*
+ * The access streams shared by the benchmarks in this directory: the first touch of every page recorded in a VMEM
+ * event trace, decoded once and then only read.
+ */
+
+#ifndef VMEM_TRACE_H
+#define VMEM_TRACE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "vmem_events.h"
+
+struct vmem_access {
+  uint32_t cpu;
+  uint64_t vaddr;
+};
+
+// the faults in the order the simulation took them; empty, with a message on stderr, when the file is unusable
+inline std::vector<vmem_access> load_vmem_trace(const std::string& path)
+{
+  std::vector<vmem_access> result;
+  std::FILE* file = std::fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    fmt::print(stderr, "Unable to open {}\n", path);
+    return result;
+  }
+
+  vmem_event_file_header expected, header;
+  if (std::fread(&header, sizeof(header), 1, file) != 1 || header.magic != expected.magic || header.record_size != expected.record_size) {
+    fmt::print(stderr, "{} is not a VMEM event trace\n", path);
+    std::fclose(file);
+    return result;
+  }
+
+  std::vector<vmem_event> buffer(1 << 14);
+  while (auto read = std::fread(buffer.data(), sizeof(vmem_event), buffer.size(), file)) {
+    for (std::size_t i = 0; i < read; i++) {
+      auto type = buffer[i].type;
+      if (type == vmem_event_type::fault || type == vmem_event_type::merge || type == vmem_event_type::huge_fault || type == vmem_event_type::major_fault
+          || type == vmem_event_type::shared_fault)
+        result.push_back({buffer[i].cpu, buffer[i].vaddr});
+    }
+  }
+  std::fclose(file);
+  return result;
+}
+
+#endif
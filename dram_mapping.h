@@ -0,0 +1,110 @@
+/*
+ * The address mappers in Yanezs_RASL.cc and Raymonds.cc without Ramulator, so that the frame allocator can tell which
+ * channel, rank, bank and row a physical address will land in. dram_address_map compiles the same field lists
+ * (mapping_schemes in mapping_program.h) the mappers compile in setup(), so the two slice bits the same way.
+ */
+
+#ifndef DRAM_MAPPING_H
+#define DRAM_MAPPING_H
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "mapping_program.h"
+
+enum class dram_mapping { RoRaCoBaBgCh, PBPI_Mapping, RASL, MINE };
+
+// Ramulator's organization in bits per level, column bits already reduced by the internal prefetch size.
+// The defaults are DDR4 8Gb x8 with one channel and two ranks: 64B transactions, 2^16 rows, 2^7 column bursts.
+struct dram_geometry {
+  unsigned channel_bits = 0;
+  unsigned rank_bits = 1;
+  unsigned bankgroup_bits = 2;
+  unsigned bank_bits = 2;
+  unsigned row_bits = 16;
+  unsigned column_bits = 7;
+  unsigned tx_offset = 6; // log2 of the transaction size in bytes
+
+  uint64_t banks() const { return 1ull << (channel_bits + rank_bits + bankgroup_bits + bank_bits); }
+  uint64_t rows() const { return 1ull << row_bits; }
+};
+
+struct dram_coordinates {
+  uint64_t channel = 0;
+  uint64_t rank = 0;
+  uint64_t bankgroup = 0;
+  uint64_t bank = 0;
+  uint64_t row = 0;
+  uint64_t column = 0;
+
+  // one index per bank across the whole memory, channel most significant
+  uint64_t bank_id(const dram_geometry& geometry) const
+  {
+    return (((channel << geometry.rank_bits | rank) << geometry.bankgroup_bits | bankgroup) << geometry.bank_bits) | bank;
+  }
+};
+
+// the names the mappers are registered under in Ramulator
+inline dram_mapping parse_dram_mapping(const std::string& name)
+{
+  if (name == "RoRaCoBaBgCh")
+    return dram_mapping::RoRaCoBaBgCh;
+  if (name == "PBPI_Mapping")
+    return dram_mapping::PBPI_Mapping;
+  if (name == "RASL")
+    return dram_mapping::RASL;
+  if (name == "MINE")
+    return dram_mapping::MINE;
+  throw std::runtime_error("Unknown DRAM address mapping " + name);
+}
+
+// the mapper's field list from mapping_program.h compiled for the geometry, with the levels in Ramulator's DDR4 order
+// (channel, rank, bankgroup, bank, row, column); a spec without bank groups is a geometry with bankgroup_bits 0
+class dram_address_map
+{
+  mapping_program program;
+
+public:
+  dram_address_map() = default;
+  dram_address_map(dram_mapping mapping, const dram_geometry& geometry)
+  {
+    mapping_levels levels{{static_cast<int>(geometry.channel_bits), static_cast<int>(geometry.rank_bits), static_cast<int>(geometry.bankgroup_bits),
+                           static_cast<int>(geometry.bank_bits), static_cast<int>(geometry.row_bits), static_cast<int>(geometry.column_bits)},
+                          geometry.tx_offset, 0, 1, 2, 3, 4, 5};
+    switch (mapping) {
+    case dram_mapping::RoRaCoBaBgCh:
+      program = mapping_schemes::RoRaCoBaBgCh(levels);
+      break;
+    case dram_mapping::PBPI_Mapping:
+      program = mapping_schemes::PBPI_Mapping(levels);
+      break;
+    case dram_mapping::RASL:
+      program = mapping_schemes::RASL(levels);
+      break;
+    case dram_mapping::MINE:
+      program = mapping_schemes::MINE(levels);
+      break;
+    }
+  }
+
+  dram_coordinates operator()(uint64_t paddr) const
+  {
+    auto addr = static_cast<int64_t>(paddr);
+    std::array<int, 6> values;
+    std::array<int*, 6> levels = {&values[0], &values[1], &values[2], &values[3], &values[4], &values[5]};
+    program.run(&addr, 1, levels.data());
+
+    dram_coordinates result;
+    result.channel = static_cast<uint64_t>(values[0]);
+    result.rank = static_cast<uint64_t>(values[1]);
+    result.bankgroup = static_cast<uint64_t>(values[2]);
+    result.bank = static_cast<uint64_t>(values[3]);
+    result.row = static_cast<uint64_t>(values[4]);
+    result.column = static_cast<uint64_t>(values[5]);
+    return result;
+  }
+};
+
+#endif
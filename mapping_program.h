@@ -0,0 +1,245 @@
+/*
+ * The bit slicing of the mappers in Yanezs_RASL.cc, Raymonds.cc and Descriptor_Mapping.cc, compiled in setup() into a
+ * flat list of (shift, mask, xor mask, level) operations and run over a batch of physical addresses at once. Every
+ * level comes out as its own array (structure of arrays), so each operation is the same shifts and masks down a
+ * column of addresses: 8 per instruction when built with AVX-512, 4 with AVX2, one at a time otherwise.
+ * A mapper's apply() is a batch of one.
+ *
+ * The field lists of the built-in mappers live in mapping_schemes below, where dram_mapping.h compiles them too, so
+ * the frame allocator in Davids_Paging.cc always slices addresses like the mapper of the same name. This header only
+ * needs C++17, like ChampSim.
+ */
+
+#ifndef MAPPING_PROGRAM_H
+#define MAPPING_PROGRAM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+// one run of consecutive address bits that keeps its order on the way into a level
+struct mapping_op {
+  uint64_t mask;      // the run length, as a mask
+  uint64_t xor_mask;  // mask, or 0 when the run has no xor source
+  uint8_t src_shift;  // where the run starts in the physical address
+  uint8_t xor_shift;  // where its xor source starts in the physical address
+  uint8_t dst_shift;  // where it lands in the level
+  uint8_t level;
+  bool first;         // the level's first run, which stores instead of or-ing into the level
+};
+
+class mapping_program
+{
+public:
+  std::vector<mapping_op> ops;
+  std::vector<uint32_t> level_add;  // added to each finished level, modulo level_mask
+  std::vector<uint32_t> level_mask; // all ones unless the mapper reduces the level
+
+  // an empty program over levels levels, for addresses whose first tx_offset bits pick a byte in the transaction
+  void reset(std::size_t levels, unsigned tx_offset)
+  {
+    m_tx_offset = tx_offset;
+    ops.clear();
+    level_add.assign(levels, 0);
+    level_mask.assign(levels, ~0u);
+    m_mapped.assign(levels, false);
+    m_unmapped.assign(levels, false);
+  }
+
+  // bits bits from bit src of the address above the transaction offset into bit dst of level, xored with the
+  // physical address bits from xor_src on when that is not negative
+  void field(int level, unsigned src, unsigned bits, unsigned dst = 0, int xor_src = -1)
+  {
+    if (bits == 0)
+      return;
+    uint64_t mask = (1ull << bits) - 1;
+    ops.push_back({mask, xor_src < 0 ? 0 : mask, static_cast<uint8_t>(m_tx_offset + src), static_cast<uint8_t>(xor_src < 0 ? 0 : xor_src),
+                   static_cast<uint8_t>(dst), static_cast<uint8_t>(level), !m_mapped[level]});
+    m_mapped[level] = true;
+  }
+
+  // a level the mapper leaves out of the address, which run() sets to -1 rather than 0
+  void unmapped(int level)
+  {
+    m_unmapped[level] = true;
+  }
+
+  // levels[l][i] is level l of addrs[i]; every levels[l] has room for size values
+  void run(const int64_t* addrs, std::size_t size, int* const* levels) const
+  {
+    for (std::size_t begin = 0; begin < size; begin += BLOCK) {
+      std::size_t count = std::min(BLOCK, size - begin);
+      const int64_t* block = addrs + begin;
+      for (std::size_t level = 0; level < level_add.size(); level++) {
+        if (!m_mapped[level])
+          std::fill_n(levels[level] + begin, count, m_unmapped[level] ? -1 : 0);
+      }
+      for (const auto& op : ops)
+        run_op(op, block, count, levels[op.level] + begin);
+      for (std::size_t level = 0; level < level_add.size(); level++) {
+        if (m_unmapped[level] || (level_add[level] == 0 && level_mask[level] == ~0u))
+          continue;
+        int* out = levels[level] + begin;
+        for (std::size_t i = 0; i < count; i++)
+          out[i] = static_cast<int>((static_cast<uint32_t>(out[i]) + level_add[level]) & level_mask[level]);
+      }
+    }
+  }
+
+private:
+  // addresses per pass, so the block and its levels stay in L1 across the operations
+  static constexpr std::size_t BLOCK = 512;
+
+  static void run_op(const mapping_op& op, const int64_t* addrs, std::size_t count, int* out)
+  {
+    std::size_t i = 0;
+#if defined(__AVX512F__)
+    {
+      const __m512i mask = _mm512_set1_epi64(static_cast<int64_t>(op.mask));
+      const __m512i xor_mask = _mm512_set1_epi64(static_cast<int64_t>(op.xor_mask));
+      const __m128i src = _mm_cvtsi32_si128(op.src_shift);
+      const __m128i xor_src = _mm_cvtsi32_si128(op.xor_shift);
+      const __m128i dst = _mm_cvtsi32_si128(op.dst_shift);
+      const __m256i keep = _mm256_set1_epi32(op.first ? 0 : -1);
+      for (; i + 8 <= count; i += 8) {
+        __m512i addr = _mm512_loadu_si512(addrs + i);
+        __m512i value = _mm512_xor_si512(_mm512_srl_epi64(addr, src), _mm512_and_si512(_mm512_srl_epi64(addr, xor_src), xor_mask));
+        __m256i narrow = _mm512_cvtepi64_epi32(_mm512_sll_epi64(_mm512_and_si512(value, mask), dst));
+        auto* level = reinterpret_cast<__m256i*>(out + i);
+        _mm256_storeu_si256(level, _mm256_or_si256(_mm256_and_si256(_mm256_loadu_si256(level), keep), narrow));
+      }
+    }
+#endif
+#if defined(__AVX2__)
+    {
+      const __m256i mask = _mm256_set1_epi64x(static_cast<int64_t>(op.mask));
+      const __m256i xor_mask = _mm256_set1_epi64x(static_cast<int64_t>(op.xor_mask));
+      const __m128i src = _mm_cvtsi32_si128(op.src_shift);
+      const __m128i xor_src = _mm_cvtsi32_si128(op.xor_shift);
+      const __m128i dst = _mm_cvtsi32_si128(op.dst_shift);
+      const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+      const __m128i keep = _mm_set1_epi32(op.first ? 0 : -1);
+      for (; i + 4 <= count; i += 4) {
+        __m256i addr = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(addrs + i));
+        __m256i value = _mm256_xor_si256(_mm256_srl_epi64(addr, src), _mm256_and_si256(_mm256_srl_epi64(addr, xor_src), xor_mask));
+        value = _mm256_sll_epi64(_mm256_and_si256(value, mask), dst);
+        __m128i narrow = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(value, low_halves));
+        auto* level = reinterpret_cast<__m128i*>(out + i);
+        _mm_storeu_si128(level, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(level), keep), narrow));
+      }
+    }
+#endif
+    const int keep = op.first ? 0 : -1;
+    for (; i < count; i++) {
+      uint64_t addr = static_cast<uint64_t>(addrs[i]);
+      out[i] = (out[i] & keep) | static_cast<int>((((addr >> op.src_shift) ^ (addr >> op.xor_shift & op.xor_mask)) & op.mask) << op.dst_shift);
+    }
+  }
+
+  unsigned m_tx_offset = 0;
+  std::vector<bool> m_mapped;   // levels some run writes, the others are filled with 0 before level_add
+  std::vector<bool> m_unmapped; // levels filled with -1 instead, and left at that
+};
+
+// where each level sits in the mapper's addr_vec and how many address bits it has, column bits already reduced by the
+// internal prefetch size; a level the spec does not have is -1, and bankgroup is the only one the schemes may miss
+struct mapping_levels {
+  std::vector<int> bits;
+  unsigned tx_offset = 0;
+  int channel = -1;
+  int rank = -1;
+  int bankgroup = -1;
+  int bank = -1;
+  int row = -1;
+  int column = -1;
+
+  int bits_of(int level) const { return level < 0 ? 0 : bits[level]; }
+};
+
+namespace mapping_schemes
+{
+// channel, bank group, bank, column, rank, row from the lowest bits up, each level rotated left by rotate % its bits
+inline mapping_program sliced(const mapping_levels& levels, int rotate = 0)
+{
+  mapping_program program;
+  program.reset(levels.bits.size(), levels.tx_offset);
+  int src = 0;
+  for (int level : {levels.channel, levels.bankgroup, levels.bank, levels.column, levels.rank, levels.row}) {
+    if (level < 0)
+      continue;
+    int num_bits = levels.bits[level];
+    int shift = num_bits > 0 ? rotate % num_bits : 0;
+    program.field(level, src, num_bits - shift, shift);
+    program.field(level, src + num_bits - shift, shift, 0);
+    src += num_bits;
+  }
+  return program;
+}
+
+inline mapping_program RoRaCoBaBgCh(const mapping_levels& levels) { return sliced(levels); }
+
+// RASL moves bit b of every level to (b + 3) % num_bits
+inline mapping_program RASL(const mapping_levels& levels) { return sliced(levels, 3); }
+
+// the column bits below the 4KB page boundary come first, the rest after bank and bank group. Bank group and bank are
+// xored with the physical address bits from 17 up, bank group taking the low ones
+inline mapping_program PBPI_Mapping(const mapping_levels& levels)
+{
+  int bankgroup_bits = levels.bits_of(levels.bankgroup);
+  int col1_bits = 12 - static_cast<int>(levels.tx_offset) - bankgroup_bits - levels.bits_of(levels.bank) - levels.bits_of(levels.channel);
+  int col2_bits = levels.bits_of(levels.column) - col1_bits;
+  if (col1_bits < 0 || col2_bits < 0)
+    throw std::runtime_error("PBPI_Mapping needs channel, bank group and bank inside a 4KB page, they take " + std::to_string(-col1_bits)
+                             + " bits too many");
+
+  mapping_program program;
+  program.reset(levels.bits.size(), levels.tx_offset);
+  int src = 0;
+  program.field(levels.channel, src, levels.bits_of(levels.channel));
+  src += levels.bits_of(levels.channel);
+  program.field(levels.column, src, col1_bits);
+  src += col1_bits;
+  if (levels.bankgroup >= 0) {
+    program.field(levels.bankgroup, src, bankgroup_bits, 0, 17);
+    src += bankgroup_bits;
+  }
+  program.field(levels.bank, src, levels.bits_of(levels.bank), 0, 17 + bankgroup_bits);
+  src += levels.bits_of(levels.bank);
+  program.field(levels.column, src, col2_bits, col1_bits);
+  src += col2_bits;
+  for (int level : {levels.rank, levels.row}) {
+    program.field(level, src, levels.bits_of(level));
+    src += levels.bits_of(level);
+  }
+  return program;
+}
+
+// two column bits, then every level below the row in addr_vec order, then the row shifted by a Caesar cipher of 15.
+// Levels between the row and the column are not mapped and stay -1; only row and column need to be known
+inline mapping_program MINE(const mapping_levels& levels)
+{
+  mapping_program program;
+  program.reset(levels.bits.size(), levels.tx_offset);
+  program.field(levels.column, 0, 2);
+  int src = 2;
+  for (int level = 0; level < levels.row; level++) {
+    program.field(level, src, levels.bits[level]);
+    src += levels.bits[level];
+  }
+  program.field(levels.row, src, levels.bits[levels.row]);
+  int caesar_shift_1 = 15;
+  program.level_add[levels.row] = caesar_shift_1;
+  program.level_mask[levels.row] = (1u << levels.bits[levels.row]) - 1;
+  for (int level = levels.row + 1; level < levels.column; level++)
+    program.unmapped(level);
+  return program;
+}
+} // namespace mapping_schemes
+
+#endif
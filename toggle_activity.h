@@ -0,0 +1,98 @@
+/*
+ * The toggle activity the mappers in Yanezs_RASL.cc and Raymonds.cc report as power consumption: running counts of address bits that
+ * changed between consecutive requests, in constant memory however long the run. Every interval requests a line
+ * with the cumulative percentage and the counts per DRAM level is appended to a buffered file, and once more when
+ * the accumulator is destroyed, so the file grows with the number of epochs rather than rewriting every request.
+ */
+
+#ifndef TOGGLE_ACTIVITY_H
+#define TOGGLE_ACTIVITY_H
+
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class toggle_activity
+{
+public:
+  toggle_activity() = default;
+  toggle_activity(const toggle_activity&) = delete;
+  toggle_activity& operator=(const toggle_activity&) = delete;
+  ~toggle_activity() { close(); }
+
+  // an empty path or a zero interval keeps the counts without writing epochs; the file is truncated once, here
+  void open(const std::string& path, uint64_t interval, std::size_t levels)
+  {
+    close();
+    m_interval = interval;
+    m_next_epoch = interval;
+    m_requests = m_written = m_toggled = m_compared = 0;
+    m_level_toggles.assign(levels, 0);
+    m_level_bits.assign(levels, 0);
+    if (path.empty())
+      return;
+    m_file = std::fopen(path.c_str(), "w");
+    if (m_file == nullptr)
+      std::fprintf(stderr, "Unable to open file %s\n", path.c_str());
+    else
+      std::setvbuf(m_file, nullptr, _IOFBF, 1 << 16);
+  }
+
+  // the bits of one level that differ from the previous request, out of width
+  void level(std::size_t level, uint64_t changed, unsigned width)
+  {
+    m_level_toggles[level] += std::popcount(changed);
+    m_level_bits[level] += width;
+  }
+
+  // closes a request with the mapper's own toggle count, which need not be the sum of its levels
+  void request(uint64_t toggled, uint64_t compared)
+  {
+    m_toggled += toggled;
+    m_compared += compared;
+    if (++m_requests == m_next_epoch) {
+      write_epoch();
+      m_next_epoch += m_interval;
+    }
+  }
+
+  // the same percentage the mappers used to push once per request
+  double cumulative_percent() const { return m_compared == 0 ? 0 : (static_cast<double>(m_toggled) / static_cast<double>(m_compared)) * 100; }
+
+  uint64_t requests() const { return m_requests; }
+
+private:
+  void write_epoch()
+  {
+    if (m_file == nullptr || m_requests == m_written)
+      return;
+    std::fprintf(m_file, "Cumulative Power Consumption: %g%% requests %llu", cumulative_percent(), static_cast<unsigned long long>(m_requests));
+    for (std::size_t level = 0; level < m_level_toggles.size(); level++)
+      std::fprintf(m_file, " %llu/%llu", static_cast<unsigned long long>(m_level_toggles[level]), static_cast<unsigned long long>(m_level_bits[level]));
+    std::fputc('\n', m_file);
+    m_written = m_requests;
+  }
+
+  void close()
+  {
+    if (m_file == nullptr)
+      return;
+    write_epoch();
+    std::fclose(m_file);
+    m_file = nullptr;
+  }
+
+  std::FILE* m_file = nullptr;
+  uint64_t m_interval = 0;
+  uint64_t m_next_epoch = 0;
+  uint64_t m_requests = 0;
+  uint64_t m_written = 0;
+  uint64_t m_toggled = 0;
+  uint64_t m_compared = 0;
+  std::vector<uint64_t> m_level_toggles;
+  std::vector<uint64_t> m_level_bits;
+};
+
+#endif
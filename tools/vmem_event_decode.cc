@@ -0,0 +1,68 @@
+/*
+ * Decodes a VMEM event trace written by a build with -DVMEM_EVENT_TRACE=1.
+ *
+ *   g++ -std=c++17 -O2 -I. tools/vmem_event_decode.cc -lfmt -o vmem_event_decode
+ *   ./vmem_event_decode vmem_events.bin            # one line per event
+ *   ./vmem_event_decode --summary vmem_events.bin  # event counts only
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "vmem_events.h"
+
+namespace
+{
+constexpr std::array<const char*, 8> event_names = {"fault", "merge", "huge-fault", "pte-alloc", "major-fault", "reclaim", "shared-fault", "cow-copy"};
+
+const char* name_of(vmem_event_type type)
+{
+  auto index = static_cast<std::size_t>(type);
+  return index < event_names.size() ? event_names[index] : "unknown";
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  bool summary = argc == 3 && std::strcmp(argv[1], "--summary") == 0;
+  if (argc != 2 && !summary) {
+    fmt::print(stderr, "usage: {} [--summary] <event trace>\n", argv[0]);
+    return 1;
+  }
+
+  std::FILE* file = std::fopen(argv[argc - 1], "rb");
+  if (file == nullptr) {
+    fmt::print(stderr, "Unable to open {}\n", argv[argc - 1]);
+    return 1;
+  }
+
+  vmem_event_file_header expected, header;
+  if (std::fread(&header, sizeof(header), 1, file) != 1 || header.magic != expected.magic || header.record_size != expected.record_size) {
+    fmt::print(stderr, "{} is not a VMEM event trace\n", argv[argc - 1]);
+    return 1;
+  }
+
+  std::array<uint64_t, event_names.size() + 1> counts{};
+  std::vector<vmem_event> buffer(1 << 14);
+  while (auto read = std::fread(buffer.data(), sizeof(vmem_event), buffer.size(), file)) {
+    for (std::size_t i = 0; i < read; i++) {
+      const auto& event = buffer[i];
+      counts[std::min(static_cast<std::size_t>(event.type), event_names.size())]++;
+      if (!summary)
+        fmt::print("{} {} cpu: {} vaddr: {:x} paddr: {:x} arg: {}\n", event.cycle, name_of(event.type), event.cpu, event.vaddr, event.paddr, event.arg);
+    }
+  }
+  std::fclose(file);
+
+  if (summary) {
+    for (std::size_t i = 0; i < event_names.size(); i++)
+      fmt::print("{:<12} {}\n", event_names[i], counts[i]);
+    if (counts.back() > 0)
+      fmt::print("{:<12} {}\n", "unknown", counts.back());
+  }
+}
@@ -0,0 +1,90 @@
+/*
+ *    Copyright 2023 The ChampSim Contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VMEM_EVENTS_H
+#define VMEM_EVENTS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// build with -DVMEM_EVENT_TRACE=1 to record paging events; otherwise every record() call compiles away
+#ifndef VMEM_EVENT_TRACE
+#define VMEM_EVENT_TRACE 0
+#endif
+
+inline constexpr bool vmem_event_trace = VMEM_EVENT_TRACE;
+
+enum class vmem_event_type : uint16_t {
+  fault = 0,     // vaddr got a new 4KB frame, which started a new extent
+  merge = 1,     // vaddr got the frame right after its neighbour's extent
+  huge_fault = 2, // vaddr's region got a whole huge block
+  pte_alloc = 3, // a page table entry was assigned, arg is the level
+  major_fault = 4, // a reclaimed page was faulted back in
+  reclaim = 5,   // an extent was evicted, vaddr is its first page, arg its size in frames
+  shared_fault = 6, // vaddr was mapped to a frame other cpus already share, arg is its new reference count
+  cow_copy = 7   // a write to a shared page gave vaddr a copy of its own, paddr is the copy
+};
+
+// one fixed-size record per event, written to the file exactly as laid out here
+struct vmem_event {
+  uint64_t cycle;
+  uint64_t vaddr;
+  uint64_t paddr;
+  vmem_event_type type;
+  uint16_t cpu;
+  uint32_t arg;
+};
+static_assert(sizeof(vmem_event) == 32);
+
+struct vmem_event_file_header {
+  uint64_t magic = 0x315456454d454d56; // "VMEMEVT1"
+  uint64_t record_size = sizeof(vmem_event);
+};
+
+// single-producer/single-consumer ring: the simulation thread fills it, a background thread drains it to the file
+class VmemEventRecorder
+{
+  std::vector<vmem_event> ring;
+  std::atomic<uint64_t> head{0}; // next slot the producer writes
+  std::atomic<uint64_t> tail{0}; // next slot the writer reads
+  std::atomic<bool> stopping{false};
+  std::FILE* file = nullptr;
+  std::thread writer;
+
+  void drain();
+
+public:
+  explicit VmemEventRecorder(const std::string& path, std::size_t capacity = 1 << 16);
+  ~VmemEventRecorder();
+
+  VmemEventRecorder(const VmemEventRecorder&) = delete;
+  VmemEventRecorder& operator=(const VmemEventRecorder&) = delete;
+
+  void record(const vmem_event& event)
+  {
+    auto slot = head.load(std::memory_order_relaxed);
+    while (slot - tail.load(std::memory_order_acquire) == ring.size()) // full, wait for the writer rather than lose events
+      std::this_thread::yield();
+    ring[slot & (ring.size() - 1)] = event;
+    head.store(slot + 1, std::memory_order_release);
+  }
+};
+
+#endif